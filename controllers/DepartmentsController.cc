@@ -1,8 +1,12 @@
 #include "DepartmentsController.h"
 #include "../utils/utils.h"
+#include "../utils/JsonWriter.h"
 #include "../models/Person.h"
+#include "../plugins/OrgGraphPlugin.h"
+#include "../plugins/ResponseCachePlugin.h"
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -19,25 +23,121 @@ namespace drogon {
     }
 }  // namespace drogon
 
+namespace {
+
+// the keys fields= may name, in column order
+const std::vector<std::string> &departmentFields() {
+    static const std::vector<std::string> names = []() {
+        std::vector<std::string> columns;
+        for (size_t i = 0; i < Department::getColumnNumber(); ++i) {
+            columns.push_back(Department::getColumnName(i));
+        }
+        return columns;
+    }();
+    return names;
+}
+
+// A page written the way serializing each toJson() trimmed by keepFields() would write it;
+// fields has its bits in departmentFields() order.
+std::string departmentsBody(const std::vector<Department> &departments, uint32_t fields) {
+    if (departments.empty()) {
+        // what an empty Json::Value array serializes to
+        return "null";
+    }
+    std::string body;
+    body.reserve(departments.size() * 48);
+    JsonWriter writer{body};
+    writer.beginArray();
+    for (const auto &d : departments) {
+        writer.beginObject();
+        if (fields & 1u) {
+            writer.member("id", d.getValueOfId());
+        }
+        if (fields & 2u) {
+            writer.member("name", d.getValueOfName());
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+    return body;
+}
+
+}  // namespace
+
 void DepartmentsController::get(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
     LOG_DEBUG << "get";
     auto offset = req->getOptionalParameter<int>("offset").value_or(0);
     auto limit = req->getOptionalParameter<int>("limit").value_or(25);
     auto sortField = req->getOptionalParameter<std::string>("sort_field").value_or("id");
-    auto sortOrder = req->getOptionalParameter<std::string>("sort_order").value_or("asc");
+    auto sortOrder = sortOrderParam(req);
+    auto after = req->getOptionalParameter<std::string>("after");
     auto sortOrderEnum = sortOrder == "asc" ? SortOrder::ASC : SortOrder::DESC;
 
+    bool knownField = false;
+    for (size_t i = 0; i < Department::getColumnNumber(); ++i) {
+        knownField = knownField || Department::getColumnName(i) == sortField;
+    }
+    if (!knownField || (sortOrder != "asc" && sortOrder != "desc")) {
+        badRequest(std::move(callback), "sort_field must be a department column and sort_order asc or desc");
+        return;
+    }
+    uint32_t fields = ~0u;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, departmentFields(), fields)) {
+        badRequest(std::move(callback), "fields must list department columns");
+        return;
+    }
+    if (auto idsParam = req->getOptionalParameter<std::string>("ids")) {
+        std::vector<int32_t> ids;
+        if (!parseIds(*idsParam, ids)) {
+            badRequest(std::move(callback), "ids must be a comma separated list of at most " + std::to_string(kMaxBatchIds) + " department ids");
+            return;
+        }
+        getByIds(req, std::move(callback), std::move(ids), fields);
+        return;
+    }
+    std::string afterValue;
+    int32_t afterId = 0;
+    if (after && !decodeKeyset(*after, sortField, sortOrder, afterValue, afterId)) {
+        badRequest(std::move(callback), "invalid cursor for this sort_field and sort_order");
+        return;
+    }
+
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
     Mapper<Department> mp(dbClientPtr);
-    mp.orderBy(sortField, sortOrderEnum).offset(offset).limit(limit).findAll(
-        [callbackPtr](const std::vector<Department> &departments) {
-            Json::Value ret{};
-            for (auto d : departments) {
-                ret.append(d.toJson());
+    // id breaks ties so that pages never overlap and cursors always point to one row
+    mp.orderBy(sortField, sortOrderEnum).orderBy(Department::Cols::_id, sortOrderEnum).limit(limit);
+    Criteria criteria;
+    if (after) {
+        auto seek = sortOrderEnum == SortOrder::ASC ? CompareOperator::GT : CompareOperator::LT;
+        criteria = Criteria(sortField, seek, afterValue) ||
+                   (Criteria(sortField, CompareOperator::EQ, afterValue) && Criteria(Department::Cols::_id, seek, afterId));
+    } else {
+        mp.offset(offset);
+    }
+    mp.findBy(
+        criteria,
+        [req, callbackPtr, sortField, sortOrder, limit, fields](const std::vector<Department> &departments) {
+            std::string seed = std::to_string(fields) + '\x1e';
+            for (const auto &d : departments) {
+                seed += std::to_string(d.getValueOfId()) + '\x1f' + d.getValueOfName() + '\x1e';
             }
-            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            auto etag = makeETag(seed);
+            if (matchesETag(req, etag)) {
+                (*callbackPtr)(notModified(etag));
+                return;
+            }
+
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setContentTypeCode(CT_APPLICATION_JSON);
+            resp->setBody(departmentsBody(departments, fields));
             resp->setStatusCode(HttpStatusCode::k200OK);
+            resp->addHeader("ETag", etag);
+            if (static_cast<int>(departments.size()) == limit) {
+                const auto &last = departments.back();
+                resp->addHeader("X-Next-Cursor", encodeKeyset(sortField, sortOrder, last.toJson()[sortField].asString(), last.getValueOfId()));
+            }
             (*callbackPtr)(resp);
         },
         [callbackPtr](const DrogonDbException &e) {
@@ -50,22 +150,48 @@ void DepartmentsController::get(const HttpRequestPtr &req, std::function<void(co
 
 void DepartmentsController::getOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int departmentId) const {
     LOG_DEBUG << "getOne departmentId: "<< departmentId;
+    uint32_t fields = ~0u;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, departmentFields(), fields)) {
+        badRequest(std::move(callback), "fields must list department columns");
+        return;
+    }
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    auto *missingPtr = cachePtr != nullptr ? &cachePtr->missingDepartments() : nullptr;
+    if (missingPtr != nullptr && missingPtr->contains(departmentId)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        callback(resp);
+        return;
+    }
+    auto missingTicket = missingPtr != nullptr ? missingPtr->ticket() : 0;
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
 
     Mapper<Department> mp(dbClientPtr);
     mp.findByPrimaryKey(
         departmentId,
-        [callbackPtr](const Department &department) {
+        [req, callbackPtr, fields](const Department &department) {
+            auto etag = makeETag(std::to_string(fields) + '\x1e' + std::to_string(department.getValueOfId()) + '\x1f' + department.getValueOfName());
+            if (matchesETag(req, etag)) {
+                (*callbackPtr)(notModified(etag));
+                return;
+            }
+
             Json::Value ret{};
             ret = department.toJson();
+            keepFields(ret, departmentFields(), fields);
             auto resp = HttpResponse::newHttpJsonResponse(ret);
-            resp->setStatusCode(HttpStatusCode::k201Created);
+            resp->setStatusCode(HttpStatusCode::k200OK);
+            resp->addHeader("ETag", etag);
             (*callbackPtr)(resp);
         },
-        [callbackPtr](const DrogonDbException &e) {
+        [callbackPtr, missingPtr, departmentId, missingTicket](const DrogonDbException &e) {
             const drogon::orm::UnexpectedRows *s = dynamic_cast<const drogon::orm::UnexpectedRows *>(&e.base());
             if(s) {
+                if (missingPtr != nullptr) {
+                    missingPtr->add(departmentId, missingTicket);
+                }
                 auto resp = HttpResponse::newHttpResponse();
                 resp->setStatusCode(k404NotFound);
                 (*callbackPtr)(resp);
@@ -78,6 +204,39 @@ void DepartmentsController::getOne(const HttpRequestPtr &req, std::function<void
     });
 }
 
+void DepartmentsController::getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields) const {
+    LOG_DEBUG << "getByIds count: " << ids.size();
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+    auto array = idArray(ids);
+
+    *dbClientPtr << "select * from department where id = any($1::int[])"
+                 << array
+                 >> [req, callbackPtr, ids = std::move(ids), fields](const Result &result)
+                   {
+                      std::unordered_map<int32_t, Json::Value> found;
+                      for (const auto &row : result) {
+                          Department department(row);
+                          auto json = department.toJson();
+                          keepFields(json, departmentFields(), fields);
+                          found.emplace(department.getValueOfId(), std::move(json));
+                      }
+                      Json::Value ret(Json::arrayValue);
+                      for (auto id : ids) {
+                          auto it = found.find(id);
+                          ret.append(it != found.end() ? it->second : notFoundMarker(id));
+                      }
+                      (*callbackPtr)(jsonBodyResponse(req, serialize(ret)));
+                   }
+                 >> [callbackPtr](const DrogonDbException &e)
+                   {
+                      LOG_ERROR << e.base().what();
+                      auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                      resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                      (*callbackPtr)(resp);
+                   };
+}
+
 void DepartmentsController::createOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, Department &&pDepartment) const {
     LOG_DEBUG << "createOne";
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
@@ -87,11 +246,25 @@ void DepartmentsController::createOne(const HttpRequestPtr &req, std::function<v
     mp.insert(
         pDepartment,
         [callbackPtr](const Department &department) {
-            Json::Value ret{};
-            ret = department.toJson();
-            auto resp = HttpResponse::newHttpJsonResponse(ret);
-            resp->setStatusCode(HttpStatusCode::k201Created);
-            (*callbackPtr)(resp);
+            // answer once the department is in the published snapshot
+            auto published = [callbackPtr, department]() {
+                auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                if (cachePtr != nullptr) {
+                    cachePtr->missingDepartments().erase(department.getValueOfId());
+                }
+
+                Json::Value ret{};
+                ret = department.toJson();
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                resp->setStatusCode(HttpStatusCode::k201Created);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr) {
+                orgGraphPtr->upsertDepartment(department, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -116,6 +289,7 @@ void DepartmentsController::updateOne(const HttpRequestPtr &req, std::function<v
         auto resp = HttpResponse::newHttpJsonResponse(ret);
         resp->setStatusCode(HttpStatusCode::k404NotFound);
         callback(resp);
+        return;
     }
 
     if (pDepartmentDetails.getName() != nullptr) {
@@ -125,11 +299,26 @@ void DepartmentsController::updateOne(const HttpRequestPtr &req, std::function<v
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     mp.update(
         department,
-        [callbackPtr](const std::size_t count)
+        [callbackPtr, department](const std::size_t count)
         {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
-            (*callbackPtr)(resp);
+            auto published = [callbackPtr]() {
+                // person bodies embed department names and the cache is not indexed by department
+                auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                if (cachePtr != nullptr) {
+                    cachePtr->reads().forget();
+                    cachePtr->persons().clear();
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(HttpStatusCode::k204NoContent);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr) {
+                orgGraphPtr->upsertDepartment(department, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e)
         {
@@ -149,10 +338,27 @@ void DepartmentsController::deleteOne(const HttpRequestPtr &req, std::function<v
     Mapper<Department> mp(dbClientPtr);
     mp.deleteBy(
         Criteria(Department::Cols::_id, CompareOperator::EQ, departmentId),
-        [callbackPtr](const std::size_t count) {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
-            (*callbackPtr)(resp);
+        [callbackPtr, departmentId](const std::size_t count) {
+            auto published = [callbackPtr, count]() {
+                if (count > 0) {
+                    // person bodies embed department names and the cache is not indexed by department
+                    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                    if (cachePtr != nullptr) {
+                        cachePtr->reads().forget();
+                        cachePtr->persons().clear();
+                    }
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(HttpStatusCode::k204NoContent);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr && count > 0) {
+                orgGraphPtr->eraseDepartment(departmentId, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -207,3 +413,64 @@ void DepartmentsController::getDepartmentPersons(const HttpRequestPtr &req, std:
           (*callbackPtr)(resp);
       });
 }
+
+
+void DepartmentsController::getStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int departmentId) const {
+    LOG_DEBUG << "getStats departmentId: "<< departmentId;
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    OrgGraph::DepartmentStats stats;
+    bool staffed = orgGraphPtr->read([&stats, departmentId](const OrgGraph &graph) {
+        const auto *found = graph.departmentStats(departmentId);
+        if (found == nullptr) {
+            return false;
+        }
+        stats = *found;
+        return true;
+    });
+
+    auto makeStats = [departmentId](const OrgGraph::DepartmentStats &stats) {
+        Json::Value ret{};
+        ret["id"] = departmentId;
+        ret["headcount"] = stats.headcount;
+        ret["managers"] = stats.managers;
+        ret["direct_reports"] = stats.directReports;
+        ret["average_span_of_control"] = stats.managers == 0 ? 0.0 : static_cast<double>(stats.directReports) / stats.managers;
+        return ret;
+    };
+    if (staffed) {
+        auto resp = HttpResponse::newHttpJsonResponse(makeStats(stats));
+        resp->setStatusCode(HttpStatusCode::k200OK);
+        callback(resp);
+        return;
+    }
+
+    // nobody works there: tell an empty department apart from a missing one
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+    Mapper<Department> mp(dbClientPtr);
+    mp.findByPrimaryKey(
+        departmentId,
+        [callbackPtr, makeStats](const Department &department) {
+            auto resp = HttpResponse::newHttpJsonResponse(makeStats(OrgGraph::DepartmentStats{}));
+            resp->setStatusCode(HttpStatusCode::k200OK);
+            (*callbackPtr)(resp);
+        },
+        [callbackPtr](const DrogonDbException &e) {
+            const drogon::orm::UnexpectedRows *s = dynamic_cast<const drogon::orm::UnexpectedRows *>(&e.base());
+            if(s) {
+                auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+                resp->setStatusCode(k404NotFound);
+                (*callbackPtr)(resp);
+                return;
+            }
+            LOG_ERROR << e.base().what();
+            auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+            resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+            (*callbackPtr)(resp);
+    });
+}
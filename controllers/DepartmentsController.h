@@ -1,6 +1,7 @@
 #pragma once
 
 #include <drogon/HttpController.h>
+#include <vector>
 #include "../models/Department.h"
 
 using namespace drogon;
@@ -15,6 +16,7 @@ class DepartmentsController : public drogon::HttpController<DepartmentsControlle
       ADD_METHOD_TO(DepartmentsController::updateOne, "/departments/{1}", Put, "LoginFilter");
       ADD_METHOD_TO(DepartmentsController::deleteOne, "/departments/{1}", Delete, "LoginFilter");
       ADD_METHOD_TO(DepartmentsController::getDepartmentPersons, "/departments/{1}/persons", Get, "LoginFilter");
+      ADD_METHOD_TO(DepartmentsController::getStats, "/departments/{1}/stats", Get, "LoginFilter");
     METHOD_LIST_END
 
     void get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr &)> &&callback) const;
@@ -23,4 +25,9 @@ class DepartmentsController : public drogon::HttpController<DepartmentsControlle
     void updateOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pDepartmentId, Department &&pDepartment) const;
     void deleteOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pDepartmentId) const;
     void getDepartmentPersons(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int departmentId) const;
+    void getStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int departmentId) const;
+
+ private:
+    // GET /departments?ids=..., one query for all of them
+    void getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields) const;
 };
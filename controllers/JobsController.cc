@@ -1,8 +1,12 @@
 #include "JobsController.h"
 #include "../utils/utils.h"
+#include "../utils/JsonWriter.h"
 #include "../models/Person.h"
+#include "../plugins/OrgGraphPlugin.h"
+#include "../plugins/ResponseCachePlugin.h"
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -18,25 +22,121 @@ namespace drogon {
     }
 }
 
+namespace {
+
+// the keys fields= may name, in column order
+const std::vector<std::string> &jobFields() {
+    static const std::vector<std::string> names = []() {
+        std::vector<std::string> columns;
+        for (size_t i = 0; i < Job::getColumnNumber(); ++i) {
+            columns.push_back(Job::getColumnName(i));
+        }
+        return columns;
+    }();
+    return names;
+}
+
+// A page written the way serializing each toJson() trimmed by keepFields() would write it;
+// fields has its bits in jobFields() order.
+std::string jobsBody(const std::vector<Job> &jobs, uint32_t fields) {
+    if (jobs.empty()) {
+        // what an empty Json::Value array serializes to
+        return "null";
+    }
+    std::string body;
+    body.reserve(jobs.size() * 48);
+    JsonWriter writer{body};
+    writer.beginArray();
+    for (const auto &j : jobs) {
+        writer.beginObject();
+        if (fields & 1u) {
+            writer.member("id", j.getValueOfId());
+        }
+        if (fields & 2u) {
+            writer.member("title", j.getValueOfTitle());
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+    return body;
+}
+
+}  // namespace
+
 void JobsController::get(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
     LOG_DEBUG << "get";
     auto offset = req->getOptionalParameter<int>("offset").value_or(0);
     auto limit = req->getOptionalParameter<int>("limit").value_or(25);
     auto sortField = req->getOptionalParameter<std::string>("sort_field").value_or("id");
-    auto sortOrder = req->getOptionalParameter<std::string>("sort_order").value_or("asc");
+    auto sortOrder = sortOrderParam(req);
+    auto after = req->getOptionalParameter<std::string>("after");
     auto sortOrderEnum = sortOrder == "asc" ? SortOrder::ASC : SortOrder::DESC;
 
+    bool knownField = false;
+    for (size_t i = 0; i < Job::getColumnNumber(); ++i) {
+        knownField = knownField || Job::getColumnName(i) == sortField;
+    }
+    if (!knownField || (sortOrder != "asc" && sortOrder != "desc")) {
+        badRequest(std::move(callback), "sort_field must be a job column and sort_order asc or desc");
+        return;
+    }
+    uint32_t fields = ~0u;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, jobFields(), fields)) {
+        badRequest(std::move(callback), "fields must list job columns");
+        return;
+    }
+    if (auto idsParam = req->getOptionalParameter<std::string>("ids")) {
+        std::vector<int32_t> ids;
+        if (!parseIds(*idsParam, ids)) {
+            badRequest(std::move(callback), "ids must be a comma separated list of at most " + std::to_string(kMaxBatchIds) + " job ids");
+            return;
+        }
+        getByIds(req, std::move(callback), std::move(ids), fields);
+        return;
+    }
+    std::string afterValue;
+    int32_t afterId = 0;
+    if (after && !decodeKeyset(*after, sortField, sortOrder, afterValue, afterId)) {
+        badRequest(std::move(callback), "invalid cursor for this sort_field and sort_order");
+        return;
+    }
+
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
     Mapper<Job> mp(dbClientPtr);
-    mp.orderBy(sortField, sortOrderEnum).offset(offset).limit(limit).findAll(
-        [callbackPtr](const std::vector<Job> &jobs) {
-            Json::Value ret{};
-            for (auto j : jobs) {
-                ret.append(j.toJson());
+    // id breaks ties so that pages never overlap and cursors always point to one row
+    mp.orderBy(sortField, sortOrderEnum).orderBy(Job::Cols::_id, sortOrderEnum).limit(limit);
+    Criteria criteria;
+    if (after) {
+        auto seek = sortOrderEnum == SortOrder::ASC ? CompareOperator::GT : CompareOperator::LT;
+        criteria = Criteria(sortField, seek, afterValue) ||
+                   (Criteria(sortField, CompareOperator::EQ, afterValue) && Criteria(Job::Cols::_id, seek, afterId));
+    } else {
+        mp.offset(offset);
+    }
+    mp.findBy(
+        criteria,
+        [req, callbackPtr, sortField, sortOrder, limit, fields](const std::vector<Job> &jobs) {
+            std::string seed = std::to_string(fields) + '\x1e';
+            for (const auto &j : jobs) {
+                seed += std::to_string(j.getValueOfId()) + '\x1f' + j.getValueOfTitle() + '\x1e';
             }
-            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            auto etag = makeETag(seed);
+            if (matchesETag(req, etag)) {
+                (*callbackPtr)(notModified(etag));
+                return;
+            }
+
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setContentTypeCode(CT_APPLICATION_JSON);
+            resp->setBody(jobsBody(jobs, fields));
             resp->setStatusCode(HttpStatusCode::k200OK);
+            resp->addHeader("ETag", etag);
+            if (static_cast<int>(jobs.size()) == limit) {
+                const auto &last = jobs.back();
+                resp->addHeader("X-Next-Cursor", encodeKeyset(sortField, sortOrder, last.toJson()[sortField].asString(), last.getValueOfId()));
+            }
             (*callbackPtr)(resp);
         },
         [callbackPtr](const DrogonDbException &e) {
@@ -49,22 +149,48 @@ void JobsController::get(const HttpRequestPtr &req, std::function<void(const Htt
 
 void JobsController::getOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int jobId) const {
     LOG_DEBUG << "getOne jobId: "<< jobId;
+    uint32_t fields = ~0u;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, jobFields(), fields)) {
+        badRequest(std::move(callback), "fields must list job columns");
+        return;
+    }
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    auto *missingPtr = cachePtr != nullptr ? &cachePtr->missingJobs() : nullptr;
+    if (missingPtr != nullptr && missingPtr->contains(jobId)) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        callback(resp);
+        return;
+    }
+    auto missingTicket = missingPtr != nullptr ? missingPtr->ticket() : 0;
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
 
     Mapper<Job> mp(dbClientPtr);
     mp.findByPrimaryKey(
         jobId,
-        [callbackPtr](const Job &job) {
+        [req, callbackPtr, fields](const Job &job) {
+            auto etag = makeETag(std::to_string(fields) + '\x1e' + std::to_string(job.getValueOfId()) + '\x1f' + job.getValueOfTitle());
+            if (matchesETag(req, etag)) {
+                (*callbackPtr)(notModified(etag));
+                return;
+            }
+
             Json::Value ret{};
             ret = job.toJson();
+            keepFields(ret, jobFields(), fields);
             auto resp = HttpResponse::newHttpJsonResponse(ret);
-            resp->setStatusCode(HttpStatusCode::k201Created);
+            resp->setStatusCode(HttpStatusCode::k200OK);
+            resp->addHeader("ETag", etag);
             (*callbackPtr)(resp);
         },
-        [callbackPtr](const DrogonDbException &e) {
+        [callbackPtr, missingPtr, jobId, missingTicket](const DrogonDbException &e) {
             const drogon::orm::UnexpectedRows *s = dynamic_cast<const drogon::orm::UnexpectedRows *>(&e.base());
             if(s) {
+                if (missingPtr != nullptr) {
+                    missingPtr->add(jobId, missingTicket);
+                }
                 auto resp = HttpResponse::newHttpResponse();
                 resp->setStatusCode(k404NotFound);
                 (*callbackPtr)(resp);
@@ -77,6 +203,39 @@ void JobsController::getOne(const HttpRequestPtr &req, std::function<void(const
     });
 }
 
+void JobsController::getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields) const {
+    LOG_DEBUG << "getByIds count: " << ids.size();
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+    auto array = idArray(ids);
+
+    *dbClientPtr << "select * from job where id = any($1::int[])"
+                 << array
+                 >> [req, callbackPtr, ids = std::move(ids), fields](const Result &result)
+                   {
+                      std::unordered_map<int32_t, Json::Value> found;
+                      for (const auto &row : result) {
+                          Job job(row);
+                          auto json = job.toJson();
+                          keepFields(json, jobFields(), fields);
+                          found.emplace(job.getValueOfId(), std::move(json));
+                      }
+                      Json::Value ret(Json::arrayValue);
+                      for (auto id : ids) {
+                          auto it = found.find(id);
+                          ret.append(it != found.end() ? it->second : notFoundMarker(id));
+                      }
+                      (*callbackPtr)(jsonBodyResponse(req, serialize(ret)));
+                   }
+                 >> [callbackPtr](const DrogonDbException &e)
+                   {
+                      LOG_ERROR << e.base().what();
+                      auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                      resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                      (*callbackPtr)(resp);
+                   };
+}
+
 void JobsController::createOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, Job &&pJob) const {
     LOG_DEBUG << "createOne";
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
@@ -86,11 +245,25 @@ void JobsController::createOne(const HttpRequestPtr &req, std::function<void(con
     mp.insert(
         pJob,
         [callbackPtr](const Job &job) {
-            Json::Value ret{};
-            ret = job.toJson();
-            auto resp = HttpResponse::newHttpJsonResponse(ret);
-            resp->setStatusCode(HttpStatusCode::k201Created);
-            (*callbackPtr)(resp);
+            // answer once the job is in the published snapshot
+            auto published = [callbackPtr, job]() {
+                auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                if (cachePtr != nullptr) {
+                    cachePtr->missingJobs().erase(job.getValueOfId());
+                }
+
+                Json::Value ret{};
+                ret = job.toJson();
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                resp->setStatusCode(HttpStatusCode::k201Created);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr) {
+                orgGraphPtr->upsertJob(job, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -125,6 +298,7 @@ void JobsController::updateOne(const HttpRequestPtr &req, std::function<void(con
         auto resp = HttpResponse::newHttpJsonResponse(ret);
         resp->setStatusCode(HttpStatusCode::k404NotFound);
         callback(resp);
+        return;
     }
 
     if (pJobDetails.getTitle() != nullptr) {
@@ -134,11 +308,26 @@ void JobsController::updateOne(const HttpRequestPtr &req, std::function<void(con
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     mp.update(
         job,
-        [callbackPtr](const std::size_t count)
+        [callbackPtr, job](const std::size_t count)
         {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
-            (*callbackPtr)(resp);
+            auto published = [callbackPtr]() {
+                // person bodies embed job titles and the cache is not indexed by job
+                auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                if (cachePtr != nullptr) {
+                    cachePtr->reads().forget();
+                    cachePtr->persons().clear();
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(HttpStatusCode::k204NoContent);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr) {
+                orgGraphPtr->upsertJob(job, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e)
         {
@@ -158,10 +347,27 @@ void JobsController::deleteOne(const HttpRequestPtr &req, std::function<void(con
     Mapper<Job> mp(dbClientPtr);
     mp.deleteBy(
         Criteria(Job::Cols::_id, CompareOperator::EQ, jobId),
-        [callbackPtr](const std::size_t count) {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
-            (*callbackPtr)(resp);
+        [callbackPtr, jobId](const std::size_t count) {
+            auto published = [callbackPtr, count]() {
+                if (count > 0) {
+                    // person bodies embed job titles and the cache is not indexed by job
+                    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                    if (cachePtr != nullptr) {
+                        cachePtr->reads().forget();
+                        cachePtr->persons().clear();
+                    }
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(HttpStatusCode::k204NoContent);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr && count > 0) {
+                orgGraphPtr->eraseJob(jobId, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <drogon/HttpController.h>
+#include <vector>
 #include "../models/Job.h"
 
 using namespace drogon;
@@ -23,4 +24,8 @@ class JobsController : public drogon::HttpController<JobsController> {
     void updateOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pJobId, Job &&pJob) const;
     void deleteOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pJobId) const;
     void getJobPersons(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int jobId) const;
+
+ private:
+    // GET /jobs?ids=..., one query for all of them
+    void getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields) const;
 };
@@ -0,0 +1,181 @@
+#include "OrgController.h"
+#include "../utils/utils.h"
+#include "../utils/OrgDiff.h"
+#include "../plugins/ChangeListenerPlugin.h"
+#include "../plugins/OrgGraphPlugin.h"
+#include "../plugins/ResponseCachePlugin.h"
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <utility>
+
+using namespace drogon::orm;
+
+namespace {
+
+// dates or timestamps Postgres reads unambiguously, e.g. 2024-03-04 or 2024-03-04T09:30:00+02:00
+bool isTimestamp(const std::string &value) {
+    static const std::regex pattern(R"(\d{4}-\d{2}-\d{2}([ T]\d{2}:\d{2}(:\d{2}(\.\d+)?)?)?(Z|[+-]\d{2}(:?\d{2})?)?)");
+    return std::regex_match(value, pattern);
+}
+
+std::optional<int32_t> optionalInt(const Row &row, const char *column) {
+    if (row[column].isNull()) {
+        return std::nullopt;
+    }
+    return row[column].as<int32_t>();
+}
+
+}  // namespace
+
+void OrgController::getDiff(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
+    LOG_DEBUG << "getDiff";
+    auto from = req->getOptionalParameter<std::string>("from");
+    auto to = req->getOptionalParameter<std::string>("to");
+    auto since = req->getOptionalParameter<std::string>("since");
+    if (!from == !since || (from && !isTimestamp(*from)) || (to && (since || !isTimestamp(*to)))) {
+        badRequest(std::move(callback), "either from (and optionally to) as dates or timestamps, or since as a cursor");
+        return;
+    }
+    std::string sinceXid;
+    if (since && !decodeJournalCursor(*since, sinceXid)) {
+        badRequest(std::move(callback), "invalid cursor");
+        return;
+    }
+
+    // Journal ids and timestamps are taken before the writing transaction commits, so a poll by
+    // either can pass over a row that commits later with a smaller one. Only rows whose
+    // transaction is older than every one still running are served, and the next poll starts
+    // from there: nothing can still commit below that line.
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+    *dbClientPtr << "with horizon as ( \n\
+                         select pg_snapshot_xmin(pg_current_snapshot()) as next_xid, pruned_xid, pruned_before \n\
+                         from org_journal_horizon) \n\
+                     select h.next_xid::text as next_xid, \n\
+                            coalesce($1::xid8 <= h.pruned_xid, $2::timestamptz < h.pruned_before) as pruned, \n\
+                            j.entity, j.entity_id, j.kind, j.old_manager_id, j.manager_id, j.old_department_id, j.department_id \n\
+                     from horizon h \n\
+                     left join org_journal j on j.xid < h.next_xid \n\
+                          and ($1::xid8 is null or j.xid >= $1::xid8) \n\
+                          and ($2::timestamptz is null or j.changed_at > $2::timestamptz) \n\
+                          and ($3::timestamptz is null or j.changed_at <= $3::timestamptz) \n\
+                     order by j.id"
+                 << (since ? std::make_shared<std::string>(sinceXid) : std::shared_ptr<std::string>())
+                 << (from ? std::make_shared<std::string>(*from) : std::shared_ptr<std::string>())
+                 << (to ? std::make_shared<std::string>(*to) : std::shared_ptr<std::string>())
+                 >> [callbackPtr, window = to.has_value()](const Result &result)
+                   {
+                      // the left join always yields the horizon row, with no journal columns if nothing changed
+                      if (result[0]["pruned"].as<bool>()) {
+                          auto resp = HttpResponse::newHttpJsonResponse(
+                              makeErrResp("the journal no longer goes back that far, start again from a later timestamp"));
+                          resp->setStatusCode(HttpStatusCode::k410Gone);
+                          (*callbackPtr)(resp);
+                          return;
+                      }
+                      OrgDiff diff;
+                      size_t changes = 0;
+                      for (const auto &row : result) {
+                          if (row["entity"].isNull()) {
+                              continue;
+                          }
+                          OrgDiff::Entry entry;
+                          entry.entity = row["entity"].as<std::string>();
+                          entry.entityId = row["entity_id"].as<int32_t>();
+                          entry.kind = row["kind"].as<std::string>();
+                          entry.oldManagerId = optionalInt(row, "old_manager_id");
+                          entry.managerId = optionalInt(row, "manager_id");
+                          entry.oldDepartmentId = optionalInt(row, "old_department_id");
+                          entry.departmentId = optionalInt(row, "department_id");
+                          diff.add(entry);
+                          ++changes;
+                      }
+
+                      auto ret = diff.toJson();
+                      ret["changes"] = static_cast<Json::UInt64>(changes);
+                      // a window ending at to has no well-defined continuation
+                      if (!window) {
+                          ret["next"] = encodeJournalCursor(result[0]["next_xid"].as<std::string>());
+                      }
+                      auto resp = HttpResponse::newHttpJsonResponse(ret);
+                      resp->setStatusCode(HttpStatusCode::k200OK);
+                      (*callbackPtr)(resp);
+                   }
+                 >> [callbackPtr](const DrogonDbException &e)
+                   {
+                      LOG_ERROR << e.base().what();
+                      auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                      resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                      (*callbackPtr)(resp);
+                   };
+}
+
+void OrgController::getLevel(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int depth) const {
+    LOG_DEBUG << "getLevel depth: " << depth;
+    if (depth < 0) {
+        badRequest(std::move(callback), "depth must not be negative");
+        return;
+    }
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    Json::Value ret(Json::arrayValue);
+    orgGraphPtr->read([&ret, depth](const OrgGraph &graph) {
+        for (const auto *person : graph.atDepth(depth)) {
+            ret.append(person->toJson());
+        }
+    });
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void OrgController::getCacheStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
+    LOG_DEBUG << "getCacheStats";
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    if (cachePtr == nullptr) {
+        badRequest(std::move(callback), "response cache is disabled", HttpStatusCode::k404NotFound);
+        return;
+    }
+
+    auto stats = cachePtr->persons().stats();
+    Json::Value ret{};
+    ret["persons"]["hits"] = static_cast<Json::UInt64>(stats.hits);
+    ret["persons"]["misses"] = static_cast<Json::UInt64>(stats.misses);
+    ret["persons"]["evictions"] = static_cast<Json::UInt64>(stats.evictions);
+    ret["persons"]["entries"] = static_cast<Json::UInt64>(stats.entries);
+    ret["persons"]["bytes"] = static_cast<Json::UInt64>(stats.bytes);
+    for (auto [name, missing] : {std::make_pair("persons", &cachePtr->missingPersons()),
+                                 std::make_pair("departments", &cachePtr->missingDepartments()),
+                                 std::make_pair("jobs", &cachePtr->missingJobs())}) {
+        ret["missing"][name]["entries"] = static_cast<Json::UInt64>(missing->size());
+        ret["missing"][name]["hits"] = static_cast<Json::UInt64>(missing->hits());
+    }
+    ret["reads"]["in_flight"] = static_cast<Json::UInt64>(cachePtr->reads().inFlight());
+    ret["reads"]["coalesced"] = static_cast<Json::UInt64>(cachePtr->reads().coalesced());
+    if (auto *listenerPtr = drogon::app().getPlugin<ChangeListenerPlugin>()) {
+        ret["changes"]["applied"] = static_cast<Json::UInt64>(listenerPtr->applied());
+        ret["changes"]["skipped"] = static_cast<Json::UInt64>(listenerPtr->skipped());
+    }
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void OrgController::getReady(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
+    LOG_DEBUG << "getReady";
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    Json::Value ret{};
+    ret["ready"] = orgGraphPtr != nullptr && orgGraphPtr->isReady();
+    if (ret["ready"].asBool()) {
+        ret["epoch"] = static_cast<Json::UInt64>(orgGraphPtr->epoch());
+    }
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(ret["ready"].asBool() ? HttpStatusCode::k200OK : HttpStatusCode::k503ServiceUnavailable);
+    callback(resp);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+
+using namespace drogon;
+
+class OrgController : public drogon::HttpController<OrgController> {
+ public:
+    METHOD_LIST_BEGIN
+      ADD_METHOD_TO(OrgController::getDiff, "/org/diff", Get, "LoginFilter");
+      ADD_METHOD_TO(OrgController::getLevel, "/org/levels/{1}", Get);
+      ADD_METHOD_TO(OrgController::getCacheStats, "/org/cache", Get, "LoginFilter");
+      ADD_METHOD_TO(OrgController::getReady, "/org/ready", Get);
+    METHOD_LIST_END
+
+    void getDiff(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const;
+    void getLevel(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int depth) const;
+    void getCacheStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const;
+    void getReady(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const;
+};
@@ -1,9 +1,23 @@
 #include "PersonsController.h"
 #include "../utils/utils.h"
+#include "../utils/FilterExpr.h"
+#include "../utils/JsonWriter.h"
+#include "../plugins/OrgGraphPlugin.h"
+#include "../plugins/ResponseCachePlugin.h"
+#include "../models/Department.h"
+#include "../models/Job.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
-#include <regex>
 
 using namespace drogon::orm;
 using namespace drogon_model::org_chart;
@@ -21,96 +35,886 @@ namespace drogon {
     }
 }  // namespace drogon
 
+namespace {
+
+// the keys fields= may name, in PersonField bit order
+const std::vector<std::string> kPersonFields{"id", "first_name", "last_name", "hire_date", "manager", "department", "job"};
+
+// Person columns filter= may compare, named through the model so a renamed column fails to build.
+// Built on first use, as the names are statics of another translation unit.
+const std::vector<FilterExpr::Column> &personFilterColumns() {
+    static const std::vector<FilterExpr::Column> columns{{Person::Cols::_id, FilterExpr::Type::kInteger},
+                                                         {Person::Cols::_manager_id, FilterExpr::Type::kInteger},
+                                                         {Person::Cols::_department_id, FilterExpr::Type::kInteger},
+                                                         {Person::Cols::_job_id, FilterExpr::Type::kInteger},
+                                                         {Person::Cols::_hire_date, FilterExpr::Type::kDate},
+                                                         {Person::Cols::_first_name, FilterExpr::Type::kText},
+                                                         {Person::Cols::_last_name, FilterExpr::Type::kText}};
+    return columns;
+}
+
+const std::string kJoinedSelect = "select person.*, \n\
+                                   job.title as job_title, \n\
+                                   department.name as department_name, \n\
+                                   concat(manager.first_name, ' ', manager.last_name) as manager_full_name \n\
+                                   from person \n\
+                                   join job on person.job_id =job.id \n\
+                                   join department on person.department_id=department.id \n\
+                                   join person as manager on person.manager_id = manager.id \n";
+
+// Select list and joins for a sparse fieldset: id, the sort column and whatever the requested
+// keys are built from. Unless names are stitched from the snapshot, only the joins for the
+// requested nested objects are made; every person has a job, a department and a manager, so
+// leaving a join out never changes which rows match.
+std::string personSelect(uint32_t fields, bool stitched, const std::string &sortField) {
+    std::vector<std::string> columns{"id"};
+    std::string names;
+    std::string joins;
+    auto need = [&columns](const std::string &column) {
+        if (std::find(columns.begin(), columns.end(), column) == columns.end()) {
+            columns.push_back(column);
+        }
+    };
+    if (fields & PersonsController::kFirstName) {
+        need("first_name");
+    }
+    if (fields & PersonsController::kLastName) {
+        need("last_name");
+    }
+    if (fields & PersonsController::kHireDate) {
+        need("hire_date");
+    }
+    if (fields & PersonsController::kManager) {
+        need("manager_id");
+        if (!stitched) {
+            names += ", concat(manager.first_name, ' ', manager.last_name) as manager_full_name";
+            joins += "join person as manager on person.manager_id = manager.id \n";
+        }
+    }
+    if (fields & PersonsController::kDepartment) {
+        need("department_id");
+        if (!stitched) {
+            names += ", department.name as department_name";
+            joins += "join department on person.department_id=department.id \n";
+        }
+    }
+    if (fields & PersonsController::kJob) {
+        need("job_id");
+        if (!stitched) {
+            names += ", job.title as job_title";
+            joins += "join job on person.job_id =job.id \n";
+        }
+    }
+    need(sortField);
+
+    std::string sql = "select ";
+    for (size_t i = 0; i < columns.size(); ++i) {
+        sql += (i == 0 ? "person." : ", person.") + columns[i];
+    }
+    return sql + names + " \nfrom person \n" + joins;
+}
+
+// extra search hits asked of the name index, for those the snapshot does not have yet
+constexpr size_t kSearchSlack = 8;
+
+// expand= names, in ExpandRelation bit order
+const std::vector<std::string> kExpansions{"manager", "department", "job", "reports"};
+
+enum ExpandRelation : uint32_t {
+    kExpandManager = 1u << 0,
+    kExpandDepartment = 1u << 1,
+    kExpandJob = 1u << 2,
+    kExpandReports = 1u << 3,
+};
+
+// fields= and expand= of a person read. Expanding a relation needs the key it hangs off,
+// so it brings that key into the fieldset. Answers 400 and returns false for bad values.
+bool personReadOptions(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &callback, uint32_t &fields, uint32_t &expand) {
+    fields = PersonsController::kAllFields;
+    expand = 0;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, kPersonFields, fields)) {
+        badRequest(std::move(callback), "fields must list id, first_name, last_name, hire_date, manager, department or job");
+        return false;
+    }
+    auto expandParam = req->getOptionalParameter<std::string>("expand");
+    if (expandParam && !parseFields(*expandParam, kExpansions, expand)) {
+        badRequest(std::move(callback), "expand must list manager, department, job or reports");
+        return false;
+    }
+    if (expand & kExpandManager) {
+        fields |= PersonsController::kManager;
+    }
+    if (expand & kExpandDepartment) {
+        fields |= PersonsController::kDepartment;
+    }
+    if (expand & kExpandJob) {
+        fields |= PersonsController::kJob;
+    }
+    if (expand & kExpandReports) {
+        fields |= PersonsController::kId;
+    }
+    return true;
+}
+
+/**
+ * Dataloader for expand=. It collects the keys of every person on a page and
+ * reads each requested relation with one "= any($1)" query, so an expanded
+ * page costs at most four queries however many rows it has, instead of one
+ * per embedded object. The queries run concurrently; whichever finishes last
+ * embeds the records and hands the page on.
+ */
+class ExpandLoader : public std::enable_shared_from_this<ExpandLoader> {
+ public:
+    using Done = std::function<void(Json::Value &&)>;
+    using Fail = std::function<void(const DrogonDbException &)>;
+
+    static void run(Json::Value persons, uint32_t expand, Done done, Fail fail) {
+        std::shared_ptr<ExpandLoader> loader(new ExpandLoader(std::move(persons), expand, std::move(done), std::move(fail)));
+        loader->start();
+    }
+
+ private:
+    struct Relation {
+        ExpandRelation bit;
+        const char *key;      // the key in the person json: manager/department/job hold {"id": ...}, reports uses the person id
+        const char *sql;
+        const char *column;   // the column of the loaded rows that matches the key
+        Json::Value (*toJson)(const Row &row);
+        std::vector<int32_t> keys{};
+        // one record per key, or for reports an array of them
+        std::unordered_map<int32_t, Json::Value> loaded{};
+    };
+
+    ExpandLoader(Json::Value persons, uint32_t expand, Done done, Fail fail) :
+      persons_{std::move(persons)}, expand_{expand}, done_{std::move(done)}, fail_{std::move(fail)} {
+        relations_.push_back({kExpandManager, "manager", "select * from person where id = any($1::int[])", "id",
+                              [](const Row &row) { return Person(row).toJson(); }});
+        relations_.push_back({kExpandDepartment, "department", "select * from department where id = any($1::int[])", "id",
+                              [](const Row &row) { return Department(row).toJson(); }});
+        relations_.push_back({kExpandJob, "job", "select * from job where id = any($1::int[])", "id",
+                              [](const Row &row) { return Job(row).toJson(); }});
+        // the top of the org manages itself but is not its own report
+        relations_.push_back({kExpandReports, "id", "select * from person where manager_id = any($1::int[]) and id <> manager_id order by id", "manager_id",
+                              [](const Row &row) { return Person(row).toJson(); }});
+    }
+
+    static int32_t keyOf(const Json::Value &person, const Relation &relation) {
+        const auto &value = relation.bit == kExpandReports ? person["id"] : person[relation.key]["id"];
+        return value.asInt();
+    }
+
+    void start() {
+        std::vector<Relation *> wanted;
+        for (auto &relation : relations_) {
+            if ((expand_ & relation.bit) == 0) {
+                continue;
+            }
+            for (const auto &person : persons_) {
+                relation.keys.push_back(keyOf(person, relation));
+            }
+            std::sort(relation.keys.begin(), relation.keys.end());
+            relation.keys.erase(std::unique(relation.keys.begin(), relation.keys.end()), relation.keys.end());
+            if (!relation.keys.empty()) {
+                wanted.push_back(&relation);
+            }
+        }
+        if (wanted.empty()) {
+            finish();
+            return;
+        }
+
+        pending_.store(wanted.size());
+        auto dbClientPtr = drogon::app().getDbClient();
+        for (auto *relation : wanted) {
+            *dbClientPtr << relation->sql
+                         << idArray(relation->keys)
+                         >> [self = shared_from_this(), relation](const Result &result)
+                           {
+                              for (const auto &row : result) {
+                                  auto key = row[relation->column].as<int32_t>();
+                                  if (relation->bit == kExpandReports) {
+                                      relation->loaded[key].append(relation->toJson(row));
+                                  } else {
+                                      relation->loaded.emplace(key, relation->toJson(row));
+                                  }
+                              }
+                              self->settle();
+                           }
+                         >> [self = shared_from_this()](const DrogonDbException &e)
+                           {
+                              if (!self->failed_.exchange(true)) {
+                                  self->fail_(e);
+                              }
+                              self->settle();
+                           };
+        }
+    }
+
+    void settle() {
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1 && !failed_.load()) {
+            finish();
+        }
+    }
+
+    void finish() {
+        for (auto &person : persons_) {
+            for (const auto &relation : relations_) {
+                if ((expand_ & relation.bit) == 0) {
+                    continue;
+                }
+                auto it = relation.loaded.find(keyOf(person, relation));
+                if (relation.bit == kExpandReports) {
+                    person["reports"] = it != relation.loaded.end() ? it->second : Json::Value(Json::arrayValue);
+                } else {
+                    person[relation.key] = it != relation.loaded.end() ? it->second : Json::Value();
+                }
+            }
+        }
+        done_(std::move(persons_));
+    }
+
+    Json::Value persons_;
+    uint32_t expand_;
+    Done done_;
+    Fail fail_;
+    std::vector<Relation> relations_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<bool> failed_{false};
+};
+
+// The select for reads by id: full rows, or only what a sparse fieldset needs.
+std::string personQuery(uint32_t fields, bool stitched) {
+    if (fields != PersonsController::kAllFields) {
+        return personSelect(fields, stitched, "id");
+    }
+    return stitched ? "select * from person \n" : kJoinedSelect;
+}
+
+/**
+ * SQL for every (sort field, direction) the person listing accepts, built once
+ * from the Person columns. Requests only look a statement up, and since each
+ * variant is a fixed string the db client prepares it once per connection.
+ *
+ * page takes (limit, offset); after takes (sort value, id, limit) and seeks
+ * past the last row of the previous page, so deep pages cost the same as the
+ * first one.
+ *
+ * Sparse fieldsets put their own select list in front of the same ordering;
+ * there are too many of them to build up front, but each still maps to one
+ * fixed string.
+ *
+ * Filtered listings put the filter's parameters first and the page's after
+ * them. A rendered filter depends only on the filter's shape, and statements
+ * are built once per shape and kept for the kMaxShapes shapes used most
+ * recently; a shape that was dropped is simply built again.
+ */
+class PersonListStatements {
+ public:
+    struct Statements {
+        std::string page;
+        std::string after;
+    };
+
+    static auto instance() -> const PersonListStatements & {
+        static const PersonListStatements statements;
+        return statements;
+    }
+
+    /// nullptr if the field is not a person column or the order is not asc/desc.
+    auto find(const std::string &sortField, const std::string &sortOrder, bool stitched) const -> const Statements * {
+        const auto &statements = stitched ? stitched_ : joined_;
+        auto it = statements.find(key(sortField, sortOrder));
+        return it == statements.end() ? nullptr : &it->second;
+    }
+
+    static constexpr size_t kMaxShapes = 1024;
+
+    /// Same as find, reading only what the fieldset needs.
+    auto narrow(const std::string &sortField, const std::string &sortOrder, bool stitched, uint32_t fields) const -> std::optional<Statements> {
+        auto it = tails_.find(key(sortField, sortOrder));
+        if (it == tails_.end()) {
+            return std::nullopt;
+        }
+        auto select = personSelect(fields, stitched, sortField);
+        return Statements{select + it->second.page, select + it->second.after};
+    }
+
+    /// Same as narrow, for rows matching condition, whose placeholders run from $1 to $paramCount.
+    auto filtered(const std::string &sortField, const std::string &sortOrder, bool stitched, uint32_t fields,
+                  const std::string &condition, size_t paramCount) const -> std::optional<Statements> {
+        auto orderKey = key(sortField, sortOrder);
+        auto column = columns_.find(orderKey);
+        if (column == columns_.end()) {
+            return std::nullopt;
+        }
+        auto shape = orderKey + '\x1f' + (stitched ? "stitched" : "joined") + '\x1f' + std::to_string(fields) + '\x1f' + condition;
+        std::lock_guard<std::mutex> lock(shapesMutex_);
+        auto it = shapes_.find(shape);
+        if (it != shapes_.end()) {
+            recentShapes_.splice(recentShapes_.begin(), recentShapes_, it->second);
+            return it->second->second;
+        }
+        if (shapes_.size() >= kMaxShapes) {
+            shapes_.erase(recentShapes_.back().first);
+            recentShapes_.pop_back();
+        }
+        std::string select = fields != PersonsController::kAllFields ? personSelect(fields, stitched, sortField)
+                             : stitched                               ? "select * from person \n"
+                                                                      : kJoinedSelect;
+        const auto &order = column->second.second;
+        auto next = [paramCount](size_t i) { return "$" + std::to_string(paramCount + i); };
+        auto orderBy = orderClause(column->second.first, order);
+        Statements statements{select + "where " + condition + " \n" + orderBy + "limit " + next(1) + " offset " + next(2),
+                              select + seekClause(column->second.first, order, next(1), next(2)) + "and " + condition + " \n" + orderBy + "limit " + next(3)};
+        recentShapes_.emplace_front(shape, std::move(statements));
+        shapes_.emplace(std::move(shape), recentShapes_.begin());
+        return recentShapes_.front().second;
+    }
+
+ private:
+    PersonListStatements() {
+        const std::string stitched = "select * from person \n";
+        for (size_t i = 0; i < Person::getColumnNumber(); ++i) {
+            const auto &column = Person::getColumnName(i);
+            for (const std::string order : {"asc", "desc"}) {
+                auto orderBy = orderClause(column, order);
+                Statements tail{orderBy + "limit $1 offset $2", seekClause(column, order, "$1", "$2") + orderBy + "limit $3"};
+                columns_.emplace(column + " " + order, std::make_pair(column, order));
+                stitched_.emplace(column + " " + order, Statements{stitched + tail.page, stitched + tail.after});
+                joined_.emplace(column + " " + order, Statements{kJoinedSelect + tail.page, kJoinedSelect + tail.after});
+                tails_.emplace(column + " " + order, std::move(tail));
+            }
+        }
+    }
+
+    // id breaks ties so pages never overlap
+    static auto orderClause(const std::string &column, const std::string &order) -> std::string {
+        return "order by person." + column + " " + order + ", person.id " + order + " \n";
+    }
+
+    static auto seekClause(const std::string &column, const std::string &order, const std::string &value, const std::string &id) -> std::string {
+        return "where (person." + column + ", person.id) " + (order == "asc" ? ">" : "<") + " (" + value + ", " + id + ") \n";
+    }
+
+    static auto key(const std::string &sortField, const std::string &sortOrder) -> std::string {
+        auto order = sortOrder;
+        std::transform(order.begin(), order.end(), order.begin(), [](unsigned char c) { return std::tolower(c); });
+        return sortField + " " + order;
+    }
+
+    std::unordered_map<std::string, Statements> tails_;
+    std::unordered_map<std::string, Statements> stitched_;
+    std::unordered_map<std::string, Statements> joined_;
+    // sort key to (column, order)
+    std::unordered_map<std::string, std::pair<std::string, std::string>> columns_;
+    mutable std::mutex shapesMutex_;
+    // most recently used first
+    mutable std::list<std::pair<std::string, Statements>> recentShapes_;
+    mutable std::unordered_map<std::string, std::list<std::pair<std::string, Statements>>::iterator> shapes_;
+};
+
+// A body for the person cache, tagged once here rather than on every request that hits it.
+BodyCache::Body cachedBody(std::string body) {
+    auto etag = makeETag(body);
+    return std::make_shared<const BodyCache::Entry>(BodyCache::Entry{std::move(body), std::move(etag)});
+}
+
+void invalidatePerson(int32_t personId) {
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    if (cachePtr != nullptr) {
+        cachePtr->reads().forget();
+        cachePtr->persons().erase(personId);
+    }
+}
+
+// the person_no_loop trigger turned down a manager change that passed the snapshot check
+// but raced with another one
+bool isReportingLoop(const DrogonDbException &e) {
+    const auto *sqlError = dynamic_cast<const SqlError *>(&e);
+    return sqlError != nullptr && sqlError->sqlState() == "23514";
+}
+
+std::optional<int32_t> optionalId(const Json::Value &json, const char *key) {
+    const auto &value = json[key];
+    if (value.isNull()) {
+        return std::nullopt;
+    }
+    if (value.isIntegral()) {
+        return value.asInt();
+    }
+    return std::stoi(value.asString());
+}
+
+// Writes /persons/{id}/subtree a batch at a time. The walk is resumed by person id for
+// every batch, so the graph lock is never held while the socket is being written.
+class SubtreeStream {
+ public:
+    SubtreeStream(const OrgGraphPlugin *orgGraphPtr, int32_t rootId, std::optional<int32_t> afterId, uint32_t maxDepth, size_t limit) :
+      orgGraphPtr_{orgGraphPtr}, rootId_{rootId}, afterId_{afterId}, maxDepth_{maxDepth}, limit_{limit} {
+        writer_["indentation"] = "";
+        writer_["emitUTF8"] = true;
+    }
+
+    std::size_t operator()(char *buffer, std::size_t size) {
+        if (buffer == nullptr) {
+            return 0;
+        }
+        while (pending_.size() - offset_ < size && !finished_) {
+            fill();
+        }
+        auto count = std::min(size, pending_.size() - offset_);
+        memcpy(buffer, pending_.data() + offset_, count);
+        offset_ += count;
+        if (offset_ == pending_.size()) {
+            pending_.clear();
+            offset_ = 0;
+        }
+        return count;
+    }
+
+ private:
+    static constexpr size_t kBatchSize = 256;
+
+    void fill() {
+        if (!opened_) {
+            pending_ += "{\"persons\":[";
+            opened_ = true;
+        }
+
+        size_t batch = 0;
+        bool limited = false;
+        bool rootFound = true;
+        bool walked = orgGraphPtr_->read([this, &batch, &limited, &rootFound](const OrgGraph &graph) {
+            rootFound = graph.contains(rootId_);
+            return graph.walkSubtree(rootId_, afterId_, maxDepth_, [this, &batch, &limited](const OrgGraph::Node &node, uint32_t depth) {
+                if (limit_ > 0 && emitted_ == limit_) {
+                    limited = true;
+                    return false;
+                }
+                if (batch == kBatchSize) {
+                    return false;
+                }
+                auto json = node.toJson();
+                json["depth"] = depth;
+                if (emitted_ > 0) {
+                    pending_ += ',';
+                }
+                pending_ += Json::writeString(writer_, json);
+                afterId_ = node.id;
+                ++emitted_;
+                ++batch;
+                return true;
+            });
+        });
+
+        // the root or the last person sent left the org between batches; the 200 is already out, so
+        // the body says the list is cut short rather than ending as if it were complete
+        if (!walked) {
+            auto error = rootFound ? "person " + std::to_string(*afterId_) + " moved out of the subtree while it was streamed"
+                                   : "person " + std::to_string(rootId_) + " was removed while the subtree was streamed";
+            pending_ += "],\"error\":\"" + error + "; the list is incomplete\"}";
+            finished_ = true;
+            return;
+        }
+        // a short batch means the walk ran out
+        if (limited || batch < kBatchSize) {
+            pending_ += ']';
+            if (limited) {
+                pending_ += ",\"next_cursor\":\"" + encodeCursor(std::to_string(*afterId_)) + "\"";
+            }
+            pending_ += '}';
+            finished_ = true;
+        }
+    }
+
+    const OrgGraphPlugin *orgGraphPtr_;
+    int32_t rootId_;
+    std::optional<int32_t> afterId_;
+    uint32_t maxDepth_;
+    size_t limit_;
+    Json::StreamWriterBuilder writer_;
+    std::string pending_;
+    size_t offset_{0};
+    size_t emitted_{0};
+    bool opened_{false};
+    bool finished_{false};
+};
+
+// Calls write with the snapshot names are stitched from, or null when the rows carry them
+// from the joins, then reports and refreshes stale reference data like personDetailsJson().
+template <typename Write>
+void withPersonNames(OrgGraphPlugin *orgGraphPtr, bool *stalePtr, Write &&write) {
+    bool stale = false;
+    if (orgGraphPtr == nullptr) {
+        write(nullptr, stale);
+    } else {
+        orgGraphPtr->readSnapshot([&write, &stale](const OrgSnapshot &snapshot) { write(&snapshot, stale); });
+        if (stale) {
+            orgGraphPtr->refreshReferenceData();
+        }
+    }
+    if (stalePtr != nullptr) {
+        *stalePtr = stale;
+    }
+}
+
+}  // namespace
+
+PersonsController::PersonsController() {
+    // build the listing statements at startup rather than on the first request
+    PersonListStatements::instance();
+}
+
+void PersonsController::warmBodyCache(const OrgSnapshot &snapshot) {
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    if (cachePtr == nullptr) {
+        return;
+    }
+    auto &bodies = cachePtr->persons();
+    size_t warmed = 0;
+    snapshot.graph.forEachNode([&bodies, &snapshot, &warmed](const OrgGraph::Node &node) {
+        PersonDetails personDetails{node, snapshot};
+        if (personDetails.stale) {
+            return;
+        }
+        auto ticket = bodies.ticket(node.id);
+        bodies.put(node.id, cachedBody(serialize(personDetails.toJson())), ticket);
+        if (++warmed % 10000 == 0) {
+            LOG_INFO << "Warmed " << warmed << " of " << snapshot.graph.size() << " person bodies";
+        }
+    });
+    auto stats = bodies.stats();
+    LOG_INFO << "Warmed " << warmed << " person bodies, " << stats.entries << " cached in " << stats.bytes << " bytes";
+}
+
 void PersonsController::get(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
     LOG_DEBUG << "get";
     auto sort_field = req->getOptionalParameter<std::string>("sort_field").value_or("id");
-    auto sort_order = req->getOptionalParameter<std::string>("sort_order").value_or("asc");
+    auto sort_order = sortOrderParam(req);
     auto limit = req->getOptionalParameter<int>("limit").value_or(25);
     auto offset = req->getOptionalParameter<int>("offset").value_or(0);
+    auto after = req->getOptionalParameter<std::string>("after");
+    uint32_t fields = 0;
+    uint32_t expand = 0;
+    if (!personReadOptions(req, callback, fields, expand)) {
+        return;
+    }
+    auto filterParam = req->getOptionalParameter<std::string>("filter");
+    if (auto idsParam = req->getOptionalParameter<std::string>("ids")) {
+        if (filterParam) {
+            badRequest(std::move(callback), "ids and filter can't be combined");
+            return;
+        }
+        std::vector<int32_t> ids;
+        if (!parseIds(*idsParam, ids)) {
+            badRequest(std::move(callback), "ids must be a comma separated list of at most " + std::to_string(kMaxBatchIds) + " person ids");
+            return;
+        }
+        getByIds(req, std::move(callback), std::move(ids), fields, expand);
+        return;
+    }
+
+    // once the org snapshot is loaded, names are stitched from memory and only person is read
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr != nullptr && !orgGraphPtr->isReady()) {
+        orgGraphPtr = nullptr;
+    }
+    const auto &registry = PersonListStatements::instance();
+    const auto *statements = registry.find(sort_field, sort_order, orgGraphPtr != nullptr);
+    if (statements == nullptr) {
+        badRequest(std::move(callback), "sort_field must be a person column and sort_order asc or desc");
+        return;
+    }
+    std::optional<PersonListStatements::Statements> narrowed;
+    FilterExpr::Sql filter;
+    if (filterParam) {
+        std::string error;
+        auto expr = FilterExpr::parse(*filterParam, personFilterColumns(), error);
+        if (!expr) {
+            badRequest(std::move(callback), "invalid filter: " + error);
+            return;
+        }
+        filter = expr->render("person", 1);
+        narrowed = registry.filtered(sort_field, sort_order, orgGraphPtr != nullptr, fields, filter.condition, filter.params.size());
+        statements = &*narrowed;
+    } else if (fields != kAllFields) {
+        narrowed = registry.narrow(sort_field, sort_order, orgGraphPtr != nullptr, fields);
+        statements = &*narrowed;
+    }
+    std::string afterValue;
+    int32_t afterId = 0;
+    if (after && !decodeKeyset(*after, sort_field, sort_order, afterValue, afterId)) {
+        badRequest(std::move(callback), "invalid cursor for this sort_field and sort_order");
+        return;
+    }
 
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
-    const char *sql = "select person.*, \n\
-                       job.title as job_title, \n\
-                       department.name as department_name, \n\
-                       concat(manager.first_name, ' ', manager.last_name) as manager_full_name \n\
-                       from person \n\
-                       join job on person.job_id =job.id \n\
-                       join department on person.department_id=department.id \n\
-                       join person as manager on person.manager_id = manager.id \n\
-                       order by $sort_field $sort_order \n\
-                       limit $1 offset $2;";
-
-    // hack workaroun
-    auto sql_sub = std::regex_replace(sql, std::regex("\\$sort_field"), sort_field);
-    sql_sub = std::regex_replace(sql_sub, std::regex("\\$sort_order"), sort_order);
-
-    *dbClientPtr << std::string(sql_sub)
-                 << std::to_string(limit)
-                 << std::to_string(offset)
-                 >> [callbackPtr](const Result &result)
-                   {
-                      if (result.empty()) {
-                          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
-                          resp->setStatusCode(HttpStatusCode::k404NotFound);
-                          (*callbackPtr)(resp);
-                          return;
-                      }
+    auto binder = *dbClientPtr << (after ? statements->after : statements->page);
+    for (const auto &param : filter.params) {
+        binder << param;
+    }
+    if (after) {
+        binder << afterValue << afterId << std::to_string(limit);
+    } else {
+        binder << std::to_string(limit) << std::to_string(offset);
+    }
+    binder >> [req, callbackPtr, orgGraphPtr, sort_field, sort_order, limit, fields, expand](const Result &result)
+             {
+                // past the last row, which is where every keyset walk ends
+                if (result.empty()) {
+                    (*callbackPtr)(jsonBodyResponse(req, "[]"));
+                    return;
+                }
+                // a full page may have more after it; works the same whether it was reached by offset or cursor
+                std::string nextCursor;
+                if (limit > 0 && result.size() == static_cast<size_t>(limit)) {
+                    auto last = result[result.size() - 1];
+                    nextCursor = encodeKeyset(sort_field, sort_order, last[sort_field].as<std::string>(), last["id"].as<int32_t>());
+                }
 
-                      Json::Value ret{};
-                      for (auto row : result) {
-                          PersonInfo personInfo{row};
-                          PersonDetails personDetails{personInfo};
-                          ret.append(personDetails.toJson());
-                      }
+                if (expand != 0) {
+                    // the tag has to cover the embedded records as well, so it is taken from the finished body
+                    ExpandLoader::run(personDetailsJson(result, orgGraphPtr, nullptr, fields), expand,
+                                      [req, callbackPtr, nextCursor](Json::Value &&ret) {
+                                          auto resp = jsonBodyResponse(req, serialize(ret));
+                                          if (!nextCursor.empty()) {
+                                              resp->addHeader("X-Next-Cursor", nextCursor);
+                                          }
+                                          (*callbackPtr)(resp);
+                                      },
+                                      [callbackPtr](const DrogonDbException &e) {
+                                          LOG_ERROR << e.base().what();
+                                          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                                          resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                                          (*callbackPtr)(resp);
+                                      });
+                    return;
+                }
 
-                      auto resp = HttpResponse::newHttpJsonResponse(ret);
-                      resp->setStatusCode(HttpStatusCode::k200OK);
-                      (*callbackPtr)(resp);
-                   }
-                 >> [callbackPtr](const DrogonDbException &e)
+                // stitched names are as fresh as the snapshot they come from
+                std::string seed = orgGraphPtr != nullptr ? std::to_string(orgGraphPtr->epoch()) : "";
+                seed += '\x1e' + std::to_string(fields);
+                appendRows(seed, result);
+                auto etag = makeETag(seed);
+                if (matchesETag(req, etag)) {
+                    (*callbackPtr)(notModified(etag));
+                    return;
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setContentTypeCode(CT_APPLICATION_JSON);
+                resp->setBody(personDetailsBody(result, orgGraphPtr, nullptr, fields));
+                resp->setStatusCode(HttpStatusCode::k200OK);
+                resp->addHeader("ETag", etag);
+                if (!nextCursor.empty()) {
+                    resp->addHeader("X-Next-Cursor", nextCursor);
+                }
+                (*callbackPtr)(resp);
+             }
+           >> [callbackPtr](const DrogonDbException &e)
+             {
+                LOG_ERROR << e.base().what();
+                auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                (*callbackPtr)(resp);
+             };
+}
+
+void PersonsController::getOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
+    LOG_DEBUG << "getOne personId: "<< personId;
+    uint32_t fields = 0;
+    uint32_t expand = 0;
+    if (!personReadOptions(req, callback, fields, expand)) {
+        return;
+    }
+
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    // only full, unexpanded bodies are cached
+    auto *bodyCachePtr = cachePtr != nullptr && fields == kAllFields && expand == 0 ? &cachePtr->persons() : nullptr;
+    uint64_t ticket = 0;
+    if (bodyCachePtr != nullptr) {
+        if (auto body = bodyCachePtr->get(personId)) {
+            callback(jsonBodyResponse(req, body->body, body->etag));
+            return;
+        }
+        ticket = bodyCachePtr->ticket(personId);
+    }
+    auto *missingPtr = cachePtr != nullptr ? &cachePtr->missingPersons() : nullptr;
+    if (missingPtr != nullptr && missingPtr->contains(personId)) {
+        auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+        resp->setStatusCode(HttpStatusCode::k404NotFound);
+        callback(resp);
+        return;
+    }
+    auto missingTicket = missingPtr != nullptr ? missingPtr->ticket() : 0;
+
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr != nullptr && !orgGraphPtr->isReady()) {
+        orgGraphPtr = nullptr;
+    }
+    auto sql = personQuery(fields, orgGraphPtr != nullptr) + "where person.id = $1";
+    auto onResult = [req, callbackPtr, orgGraphPtr, bodyCachePtr, missingPtr, personId, ticket, missingTicket, fields, expand](const Result &result)
+                    {
+                       if (result.empty()) {
+                           if (missingPtr != nullptr) {
+                               missingPtr->add(personId, missingTicket);
+                           }
+                           auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+                           resp->setStatusCode(HttpStatusCode::k404NotFound);
+                           (*callbackPtr)(resp);
+                           return;
+                       }
+                       if (expand != 0) {
+                           ExpandLoader::run(personDetailsJson(result, orgGraphPtr, nullptr, fields), expand,
+                                             [req, callbackPtr](Json::Value &&ret) { (*callbackPtr)(jsonBodyResponse(req, serialize(ret[0]))); },
+                                             [callbackPtr](const DrogonDbException &e) {
+                                                 LOG_ERROR << e.base().what();
+                                                 auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                                                 resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                                                 (*callbackPtr)(resp);
+                                             });
+                           return;
+                       }
+
+                       bool stale = false;
+                       auto body = cachedBody(std::move(personDetailsBodies(result, orgGraphPtr, &stale, fields)[0]));
+                       if (bodyCachePtr != nullptr && !stale) {
+                           bodyCachePtr->put(personId, body, ticket);
+                       }
+                       (*callbackPtr)(jsonBodyResponse(req, body->body, body->etag));
+                    };
+    auto onError = [callbackPtr](const DrogonDbException &e)
                    {
                       LOG_ERROR << e.base().what();
                       auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
                       resp->setStatusCode(HttpStatusCode::k500InternalServerError);
                       (*callbackPtr)(resp);
                    };
+    auto query = [dbClientPtr, sql, personId](auto &&onResult, auto &&onError) {
+        *dbClientPtr << sql << personId >> std::move(onResult) >> std::move(onError);
+    };
+    if (cachePtr == nullptr) {
+        query(std::move(onResult), std::move(onError));
+        return;
+    }
+    // a burst of misses for the same person shares one query
+    cachePtr->reads().run(sql + '\x1f' + std::to_string(personId), std::move(onResult), std::move(onError), query);
 }
 
-void PersonsController::getOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
-    LOG_DEBUG << "getOne personId: "<< personId;
+void PersonsController::getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields, uint32_t expand) const {
+    LOG_DEBUG << "getByIds count: " << ids.size();
+    // bodies in request order; a null body is a person nobody has found yet
+    auto bodies = std::make_shared<std::vector<BodyCache::Body>>(ids.size());
+    auto *pluginPtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    auto *cachePtr = fields == kAllFields && expand == 0 ? pluginPtr : nullptr;
+    auto *missingPtr = pluginPtr != nullptr ? &pluginPtr->missingPersons() : nullptr;
+    auto missingTicket = missingPtr != nullptr ? missingPtr->ticket() : 0;
+    std::unordered_map<int32_t, uint64_t> tickets;
+    std::vector<int32_t> unread;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (cachePtr != nullptr && ((*bodies)[i] = cachePtr->persons().get(ids[i]))) {
+            continue;
+        }
+        // a known missing id keeps its null body and is answered with a marker
+        if (missingPtr != nullptr && missingPtr->contains(ids[i])) {
+            continue;
+        }
+        if (tickets.emplace(ids[i], cachePtr != nullptr ? cachePtr->persons().ticket(ids[i]) : 0).second) {
+            unread.push_back(ids[i]);
+        }
+    }
+
+    auto idsPtr = std::make_shared<const std::vector<int32_t>>(std::move(ids));
+    auto respond = [req, idsPtr, bodies](const std::function<void(const HttpResponsePtr &)> &callback) {
+        std::string body = "[";
+        for (size_t i = 0; i < idsPtr->size(); ++i) {
+            if (i > 0) {
+                body += ',';
+            }
+            body += (*bodies)[i] ? (*bodies)[i]->body : serialize(notFoundMarker((*idsPtr)[i]));
+        }
+        body += ']';
+        callback(jsonBodyResponse(req, body));
+    };
+    if (unread.empty()) {
+        respond(callback);
+        return;
+    }
+
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr != nullptr && !orgGraphPtr->isReady()) {
+        orgGraphPtr = nullptr;
+    }
 
-    const char *sql = "select person.*, \n\
-                       job.title as job_title, \n\
-                       department.name as department_name, \n\
-                       concat(manager.first_name, ' ', manager.last_name) as manager_full_name \n\
-                       from person \n\
-                       join job on person.job_id =job.id \n\
-                       join department on person.department_id=department.id \n\
-                       join person as manager on person.manager_id = manager.id \n\
-                       where person.id = $1";
-
-    *dbClientPtr << std::string(sql)
-                 << personId
-                 >> [callbackPtr](const Result &result)
+    *dbClientPtr << personQuery(fields, orgGraphPtr != nullptr) + "where person.id = any($1::int[])"
+                 << idArray(unread)
+                 >> [callbackPtr, orgGraphPtr, cachePtr, missingPtr, missingTicket, fields, expand, idsPtr, bodies, tickets = std::move(tickets), respond = std::move(respond)](const Result &result)
                    {
-                      if (result.empty()) {
-                          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
-                          resp->setStatusCode(HttpStatusCode::k404NotFound);
-                          (*callbackPtr)(resp);
+                      bool stale = false;
+                      // unexpanded rows are written straight to their bodies
+                      std::vector<std::string> rowBodies;
+                      Json::Value json;
+                      if (expand == 0) {
+                          rowBodies = personDetailsBodies(result, orgGraphPtr, &stale, fields);
+                      } else {
+                          json = personDetailsJson(result, orgGraphPtr, &stale, fields);
+                      }
+                      // both hold the rows in result order, but may not carry their ids
+                      std::vector<int32_t> rowIds;
+                      for (const auto &row : result) {
+                          rowIds.push_back(row["id"].as<int32_t>());
+                      }
+                      if (missingPtr != nullptr) {
+                          std::unordered_set<int32_t> present(rowIds.begin(), rowIds.end());
+                          for (const auto &entry : tickets) {
+                              if (present.count(entry.first) == 0) {
+                                  missingPtr->add(entry.first, missingTicket);
+                              }
+                          }
+                      }
+                      auto fill = [callbackPtr, cachePtr, stale, idsPtr, bodies, tickets, respond, rowIds](std::vector<std::string> &&rowBodies) {
+                          std::unordered_map<int32_t, BodyCache::Body> found;
+                          for (size_t i = 0; i < rowIds.size(); ++i) {
+                              // the batch is tagged as a whole; a row only needs its own tag to be cached
+                              auto body = cachePtr != nullptr ? cachedBody(std::move(rowBodies[i]))
+                                                              : std::make_shared<const BodyCache::Entry>(BodyCache::Entry{std::move(rowBodies[i]), ""});
+                              if (cachePtr != nullptr && !stale) {
+                                  cachePtr->persons().put(rowIds[i], body, tickets.at(rowIds[i]));
+                              }
+                              found.emplace(rowIds[i], std::move(body));
+                          }
+                          for (size_t i = 0; i < bodies->size(); ++i) {
+                              auto it = found.find((*idsPtr)[i]);
+                              if (!(*bodies)[i] && it != found.end()) {
+                                  (*bodies)[i] = it->second;
+                              }
+                          }
+                          respond(*callbackPtr);
+                      };
+                      if (expand == 0) {
+                          fill(std::move(rowBodies));
                           return;
                       }
-
-                      auto row = result[0];
-                      PersonInfo personInfo{row};
-                      PersonDetails personDetails{personInfo};
-
-                      Json::Value ret = personDetails.toJson();
-                      auto resp = HttpResponse::newHttpJsonResponse(ret);
-                      resp->setStatusCode(HttpStatusCode::k200OK);
-                      (*callbackPtr)(resp);
+                      auto serializeRows = [fill](Json::Value &&json) {
+                          std::vector<std::string> rowBodies;
+                          for (const auto &person : json) {
+                              rowBodies.push_back(serialize(person));
+                          }
+                          fill(std::move(rowBodies));
+                      };
+                      ExpandLoader::run(std::move(json), expand, serializeRows, [callbackPtr](const DrogonDbException &e) {
+                          LOG_ERROR << e.base().what();
+                          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                          resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                          (*callbackPtr)(resp);
+                      });
                    }
                  >> [callbackPtr](const DrogonDbException &e)
                    {
@@ -130,11 +934,27 @@ void PersonsController::createOne(const HttpRequestPtr &req, std::function<void(
     mp.insert(
         pPerson,
         [callbackPtr](const Person &person) {
-            Json::Value ret{};
-            ret = person.toJson();
-            auto resp = HttpResponse::newHttpJsonResponse(ret);
-            resp->setStatusCode(HttpStatusCode::k201Created);
-            (*callbackPtr)(resp);
+            // answer once the person is in the published snapshot
+            auto published = [callbackPtr, person]() {
+                // the new person is somebody's direct report, and may have been asked for before it existed
+                auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                if (cachePtr != nullptr) {
+                    cachePtr->reads().forget();
+                    cachePtr->missingPersons().erase(person.getValueOfId());
+                }
+
+                Json::Value ret{};
+                ret = person.toJson();
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                resp->setStatusCode(HttpStatusCode::k201Created);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr) {
+                orgGraphPtr->upsert(person, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -144,53 +964,279 @@ void PersonsController::createOne(const HttpRequestPtr &req, std::function<void(
     });
 }
 
-void PersonsController::updateOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId, Person &&pPerson) const {
-    LOG_DEBUG << "updateOne personId: " << personId;
-    auto dbClientPtr = drogon::app().getDbClient();
+void PersonsController::reorg(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
+    LOG_DEBUG << "reorg";
+    auto jsonPtr = req->getJsonObject();
+    if (!jsonPtr || !(*jsonPtr)["moves"].isArray() || (*jsonPtr)["moves"].empty()) {
+        badRequest(std::move(callback), "expected a non-empty moves array");
+        return;
+    }
 
-    // blocking IO
-    Mapper<Person> mp(dbClientPtr);
-    Person person;
+    auto moves = std::make_shared<std::vector<OrgGraph::Move>>();
     try {
-        person = mp.findFutureByPrimaryKey(personId).get();
-    } catch (const DrogonDbException & e) {
-        auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
-        resp->setStatusCode(HttpStatusCode::k404NotFound);
-        callback(resp);
+        for (const auto &json : (*jsonPtr)["moves"]) {
+            OrgGraph::Move move;
+            auto personId = optionalId(json, "person_id");
+            if (!personId) {
+                badRequest(std::move(callback), "every move needs a person_id");
+                return;
+            }
+            move.personId = *personId;
+            move.managerId = optionalId(json, "manager_id");
+            move.departmentId = optionalId(json, "department_id");
+            if (!move.managerId && !move.departmentId) {
+                badRequest(std::move(callback), "every move needs a manager_id or a department_id");
+                return;
+            }
+            moves->push_back(move);
+        }
+    } catch (const std::exception &e) {
+        badRequest(std::move(callback), "ids must be integers");
         return;
     }
 
-    if (pPerson.getJobId() != nullptr) {
-      person.setJobId(pPerson.getValueOfJobId());
-    }
-    if (pPerson.getManagerId() != nullptr) {
-      person.setManagerId(pPerson.getValueOfManagerId());
-    }
-    if (pPerson.getDepartmentId() != nullptr) {
-      person.setDepartmentId(pPerson.getValueOfDepartmentId());
-    }
-    if (pPerson.getFirstName() != nullptr) {
-      person.setFirstName(pPerson.getValueOfFirstName());
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
     }
-    if (pPerson.getLastName() != nullptr) {
-      person.setLastName(pPerson.getValueOfLastName());
+
+    std::string err;
+    orgGraphPtr->read([&err, &moves](const OrgGraph &graph) {
+        std::unordered_set<int32_t> seen;
+        for (const auto &move : *moves) {
+            if (!seen.insert(move.personId).second) {
+                err = "person " + std::to_string(move.personId) + " is moved more than once";
+                return;
+            }
+            if (!graph.contains(move.personId)) {
+                err = "person " + std::to_string(move.personId) + " not found";
+                return;
+            }
+            if (move.managerId && *move.managerId != move.personId && !graph.contains(*move.managerId)) {
+                err = "manager " + std::to_string(*move.managerId) + " not found";
+                return;
+            }
+        }
+        auto cycle = graph.findCycle(*moves);
+        if (cycle) {
+            err = "moving person " + std::to_string(*cycle) + " would create a reporting loop";
+        }
+    });
+    if (!err.empty()) {
+        badRequest(std::move(callback), err);
+        return;
     }
 
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
-    mp.update(
-        person,
-        [callbackPtr](const std::size_t count)
-        {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
+    auto dbClientPtr = drogon::app().getDbClient();
+    dbClientPtr->newTransactionAsync([callbackPtr, moves, orgGraphPtr](const std::shared_ptr<Transaction> &transPtr) {
+        if (!transPtr) {
+            auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+            resp->setStatusCode(HttpStatusCode::k500InternalServerError);
             (*callbackPtr)(resp);
-        },
-        [callbackPtr](const DrogonDbException &e)
+            return;
+        }
+
+        // the transaction commits once the last statement has run and every copy of transPtr is gone
+        auto failed = std::make_shared<std::atomic<bool>>(false);
+        auto updated = std::make_shared<std::atomic<size_t>>(0);
+        transPtr->setCommitCallback([callbackPtr, moves, orgGraphPtr, failed, updated](bool committed) {
+            if (!committed) {
+                // a failed statement has answered already; otherwise the COMMIT itself failed or the connection went
+                if (!failed->exchange(true)) {
+                    LOG_ERROR << "reorg transaction did not commit";
+                    auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                    resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                    (*callbackPtr)(resp);
+                }
+                return;
+            }
+            orgGraphPtr->applyMoves(*moves, [callbackPtr, moves, updated]() {
+                for (const auto &move : *moves) {
+                    invalidatePerson(move.personId);
+                }
+                Json::Value ret{};
+                ret["moved"] = static_cast<Json::UInt64>(updated->load());
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                resp->setStatusCode(HttpStatusCode::k200OK);
+                (*callbackPtr)(resp);
+            });
+        });
+
+        auto onError = [callbackPtr, transPtr, failed](const DrogonDbException &e)
         {
+            if (failed->exchange(true)) {
+                return;
+            }
+            transPtr->rollback();
+            if (isReportingLoop(e)) {
+                // another manager change committed since the snapshot check
+                auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("the moves would create a reporting loop"));
+                resp->setStatusCode(HttpStatusCode::k409Conflict);
+                (*callbackPtr)(resp);
+                return;
+            }
             LOG_ERROR << e.base().what();
             auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
             resp->setStatusCode(HttpStatusCode::k500InternalServerError);
             (*callbackPtr)(resp);
+        };
+
+        // one UPDATE ... FROM (VALUES ...) per chunk, three parameters per row; the journal
+        // trigger records every row it changes within this transaction
+        const size_t kChunkSize = 1000;
+        for (size_t first = 0; first < moves->size(); first += kChunkSize) {
+            auto last = std::min(first + kChunkSize, moves->size());
+            std::string values = "(values ";
+            for (size_t i = first; i < last; ++i) {
+                auto param = (i - first) * 3;
+                values += (i == first ? "" : ", ");
+                values += "($" + std::to_string(param + 1) + "::int, $" + std::to_string(param + 2) + "::int, $" + std::to_string(param + 3) + "::int)";
+            }
+            values += ") as v(id, manager_id, department_id)";
+
+            std::string updateSql = "update person \n\
+                                     set manager_id = coalesce(v.manager_id, person.manager_id), \n\
+                                         department_id = coalesce(v.department_id, person.department_id) \n\
+                                     from " + values + " \n\
+                                     where person.id = v.id";
+
+            auto binder = *transPtr << updateSql;
+            for (size_t i = first; i < last; ++i) {
+                const auto &move = (*moves)[i];
+                binder << move.personId;
+                if (move.managerId) {
+                    binder << *move.managerId;
+                } else {
+                    binder << nullptr;
+                }
+                if (move.departmentId) {
+                    binder << *move.departmentId;
+                } else {
+                    binder << nullptr;
+                }
+            }
+            binder >> [updated](const Result &result)
+                      {
+                         *updated += result.affectedRows();
+                      }
+                   >> onError;
+        }
+        // the loop check is deferred to commit, where its error could not be told apart; run it here
+        *transPtr << "set constraints person_no_loop immediate"
+                  >> [](const Result &) {}
+                  >> onError;
+    });
+}
+
+void PersonsController::updateOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId, Person &&pPerson) const {
+    LOG_DEBUG << "updateOne personId: " << personId;
+    auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
+    auto dbClientPtr = drogon::app().getDbClient();
+
+    Mapper<Person> mp(dbClientPtr);
+    mp.findByPrimaryKey(
+        personId,
+        [callbackPtr, dbClientPtr, personId, pPerson = std::move(pPerson)](Person person)
+        {
+            if (pPerson.getJobId() != nullptr) {
+              person.setJobId(pPerson.getValueOfJobId());
+            }
+            if (pPerson.getManagerId() != nullptr && pPerson.getValueOfManagerId() != person.getValueOfManagerId()) {
+              auto managerId = pPerson.getValueOfManagerId();
+              auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+              if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+                  auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("org graph is not loaded yet"));
+                  resp->setStatusCode(HttpStatusCode::k503ServiceUnavailable);
+                  (*callbackPtr)(resp);
+                  return;
+              }
+              // answered from the in-memory ancestor index, so a loop is rejected before it reaches the
+              // database; managing oneself puts a person at the top of the org
+              auto err = orgGraphPtr->read([personId, managerId](const OrgGraph &graph) -> std::string {
+                  if (managerId == personId) {
+                      return {};
+                  }
+                  if (!graph.contains(managerId)) {
+                      return "manager " + std::to_string(managerId) + " not found";
+                  }
+                  if (graph.reportsTo(managerId, personId)) {
+                      return "manager_id " + std::to_string(managerId) + " would create a reporting loop";
+                  }
+                  return {};
+              });
+              if (!err.empty()) {
+                  auto resp = HttpResponse::newHttpJsonResponse(makeErrResp(err));
+                  resp->setStatusCode(HttpStatusCode::k400BadRequest);
+                  (*callbackPtr)(resp);
+                  return;
+              }
+              person.setManagerId(managerId);
+            }
+            if (pPerson.getDepartmentId() != nullptr) {
+              person.setDepartmentId(pPerson.getValueOfDepartmentId());
+            }
+            if (pPerson.getFirstName() != nullptr) {
+              person.setFirstName(pPerson.getValueOfFirstName());
+            }
+            if (pPerson.getLastName() != nullptr) {
+              person.setLastName(pPerson.getValueOfLastName());
+            }
+
+            bool renamed = pPerson.getFirstName() != nullptr || pPerson.getLastName() != nullptr;
+            Mapper<Person> mp(dbClientPtr);
+            mp.update(
+                person,
+                [callbackPtr, person, personId, renamed](const std::size_t count)
+                {
+                    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+                    // erase once published: a read that takes its ticket after the erase must find the new names
+                    auto published = [callbackPtr, personId, renamed, orgGraphPtr]() {
+                        auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+                        if (cachePtr != nullptr) {
+                            cachePtr->reads().forget();
+                            cachePtr->persons().erase(personId);
+                            if (renamed && orgGraphPtr != nullptr) {
+                                // reports embed their manager's name
+                                orgGraphPtr->read([cachePtr, personId](const OrgGraph &graph) {
+                                    for (const auto *report : graph.directReports(personId)) {
+                                        cachePtr->persons().erase(report->id);
+                                    }
+                                });
+                            }
+                        }
+
+                        auto resp = HttpResponse::newHttpResponse();
+                        resp->setStatusCode(HttpStatusCode::k204NoContent);
+                        (*callbackPtr)(resp);
+                    };
+                    if (orgGraphPtr != nullptr) {
+                        orgGraphPtr->upsert(person, std::move(published));
+                    } else {
+                        published();
+                    }
+                },
+                [callbackPtr, personId](const DrogonDbException &e)
+                {
+                    if (isReportingLoop(e)) {
+                        auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("person " + std::to_string(personId) + " would be in a reporting loop"));
+                        resp->setStatusCode(HttpStatusCode::k409Conflict);
+                        (*callbackPtr)(resp);
+                        return;
+                    }
+                    LOG_ERROR << e.base().what();
+                    auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                    resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                    (*callbackPtr)(resp);
+                }
+            );
+        },
+        [callbackPtr](const DrogonDbException &e)
+        {
+            auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+            resp->setStatusCode(HttpStatusCode::k404NotFound);
+            (*callbackPtr)(resp);
         }
     );
 }
@@ -203,10 +1249,22 @@ void PersonsController::deleteOne(const HttpRequestPtr &req, std::function<void(
     Mapper<Person> mp(dbClientPtr);
     mp.deleteBy(
         Criteria(Person::Cols::_id, CompareOperator::EQ, personId),
-        [callbackPtr](const std::size_t count) {
-            auto resp = HttpResponse::newHttpResponse();
-            resp->setStatusCode(HttpStatusCode::k204NoContent);
-            (*callbackPtr)(resp);
+        [callbackPtr, personId](const std::size_t count) {
+            auto published = [callbackPtr, personId, count]() {
+                if (count > 0) {
+                    invalidatePerson(personId);
+                }
+
+                auto resp = HttpResponse::newHttpResponse();
+                resp->setStatusCode(HttpStatusCode::k204NoContent);
+                (*callbackPtr)(resp);
+            };
+            auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+            if (orgGraphPtr != nullptr && count > 0) {
+                orgGraphPtr->erase(personId, std::move(published));
+            } else {
+                published();
+            }
         },
         [callbackPtr](const DrogonDbException &e) {
             LOG_ERROR << e.base().what();
@@ -218,49 +1276,293 @@ void PersonsController::deleteOne(const HttpRequestPtr &req, std::function<void(
 
 void PersonsController::getDirectReports(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
     LOG_DEBUG << "getDirectReports personId: "<< personId;
+    auto level = req->getOptionalParameter<int>("level").value_or(1);
+    if (level < 1) {
+        badRequest(std::move(callback), "level must be at least 1");
+        return;
+    }
+
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (level > 1 && (orgGraphPtr == nullptr || !orgGraphPtr->isReady())) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+    if (orgGraphPtr != nullptr && orgGraphPtr->isReady()) {
+        Json::Value ret{};
+        orgGraphPtr->read([&ret, personId, level](const OrgGraph &graph) {
+            // direct reports come sorted by id; deeper levels in pre-order, grouped by manager
+            auto reports = level == 1 ? graph.directReports(personId) : graph.reportsAtLevel(personId, level);
+            for (const auto *report : reports) {
+                ret.append(report->toJson());
+            }
+        });
+        if (ret.empty()) {
+            auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+            resp->setStatusCode(HttpStatusCode::k404NotFound);
+            callback(resp);
+            return;
+        }
+        auto resp = HttpResponse::newHttpJsonResponse(ret);
+        resp->setStatusCode(HttpStatusCode::k200OK);
+        callback(resp);
+        return;
+    }
+
+    // graph not loaded yet: read the reports straight from person, skipping the blocking manager lookup
     auto callbackPtr = std::make_shared<std::function<void(const HttpResponsePtr &)>>(std::move(callback));
     auto dbClientPtr = drogon::app().getDbClient();
+    std::string sql = "select * from person where manager_id = $1";
+    auto onResult = [callbackPtr](const Result &result)
+                    {
+                       if (result.empty()) {
+                          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
+                          resp->setStatusCode(HttpStatusCode::k404NotFound);
+                          (*callbackPtr)(resp);
+                          return;
+                       }
+                       Json::Value ret{};
+                       for (const auto &row : result) {
+                           ret.append(Person(row).toJson());
+                       }
+                       auto resp = HttpResponse::newHttpJsonResponse(ret);
+                       resp->setStatusCode(HttpStatusCode::k200OK);
+                       (*callbackPtr)(resp);
+                    };
+    auto onError = [callbackPtr](const DrogonDbException &e)
+                   {
+                      LOG_ERROR << e.base().what();
+                      auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
+                      resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+                      (*callbackPtr)(resp);
+                   };
+    auto query = [dbClientPtr, sql, personId](auto &&onResult, auto &&onError) {
+        *dbClientPtr << sql << personId >> std::move(onResult) >> std::move(onError);
+    };
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    if (cachePtr == nullptr) {
+        query(std::move(onResult), std::move(onError));
+        return;
+    }
+    cachePtr->reads().run(sql + '\x1f' + std::to_string(personId), std::move(onResult), std::move(onError), query);
+}
 
-    // blocking IO
-    Mapper<Person> mp(dbClientPtr);
-    Person department;
-    try {
-        department = mp.findFutureByPrimaryKey(personId).get();
-    } catch (const DrogonDbException & e) {
-        auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
-        resp->setStatusCode(HttpStatusCode::k404NotFound);
-        callback(resp);
+void PersonsController::getSubtree(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
+    LOG_DEBUG << "getSubtree personId: "<< personId;
+    auto maxDepth = req->getOptionalParameter<int>("max_depth").value_or(0);
+    auto limit = req->getOptionalParameter<int>("limit").value_or(0);
+    auto cursor = req->getOptionalParameter<std::string>("cursor");
+
+    if (maxDepth < 0 || limit < 0) {
+        badRequest(std::move(callback), "max_depth and limit must not be negative");
+        return;
     }
 
-    department.getPersons(dbClientPtr,
-      [callbackPtr](const std::vector<Person> persons) {
-          if (persons.empty()) {
-             auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("resource not found"));
-             resp->setStatusCode(HttpStatusCode::k404NotFound);
-             (*callbackPtr)(resp);
-          } else {
-             Json::Value ret{};
-             for (auto p : persons) {
-                 ret.append(p.toJson());
-             }
-             auto resp = HttpResponse::newHttpJsonResponse(ret);
-             resp->setStatusCode(HttpStatusCode::k200OK);
-             (*callbackPtr)(resp);
-          }
-      },
-      [callbackPtr](const DrogonDbException &e) {
-          LOG_ERROR << e.base().what();
-          auto resp = HttpResponse::newHttpJsonResponse(makeErrResp("database error"));
-          resp->setStatusCode(HttpStatusCode::k500InternalServerError);
-          (*callbackPtr)(resp);
-      });
+    std::optional<int32_t> afterId;
+    if (cursor) {
+        try {
+            afterId = std::stoi(decodeCursor(*cursor));
+        } catch (const std::exception &e) {
+            badRequest(std::move(callback), "invalid cursor");
+            return;
+        }
+    }
+
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    // max_depth=0 means the whole subtree; the graph size also bounds the walk if bad data ever forms a loop
+    uint32_t depthLimit = 0;
+    bool found = false;
+    bool resumable = orgGraphPtr->read([&](const OrgGraph &graph) {
+        found = graph.contains(personId);
+        depthLimit = static_cast<uint32_t>(graph.size());
+        if (maxDepth > 0) {
+            depthLimit = std::min(depthLimit, static_cast<uint32_t>(maxDepth));
+        }
+        return graph.walkSubtree(personId, afterId, depthLimit, [](const OrgGraph::Node &, uint32_t) { return false; });
+    });
+    if (!found) {
+        badRequest(std::move(callback), "resource not found", HttpStatusCode::k404NotFound);
+        return;
+    }
+    if (!resumable) {
+        badRequest(std::move(callback), "invalid cursor");
+        return;
+    }
+
+    auto stream = std::make_shared<SubtreeStream>(orgGraphPtr, personId, afterId, depthLimit, static_cast<size_t>(limit));
+    auto resp = HttpResponse::newStreamResponse(
+        [stream](char *buffer, std::size_t size) { return (*stream)(buffer, size); },
+        "",
+        CT_APPLICATION_JSON);
+    callback(resp);
+}
+
+void PersonsController::search(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const {
+    auto query = req->getOptionalParameter<std::string>("q").value_or("");
+    auto limit = req->getOptionalParameter<int>("limit").value_or(20);
+    LOG_DEBUG << "search q: " << query << " limit: " << limit;
+    if (query.empty() || query.size() > 100) {
+        badRequest(std::move(callback), "q must be 1 to 100 characters");
+        return;
+    }
+    if (limit < 1 || limit > 100) {
+        badRequest(std::move(callback), "limit must be between 1 and 100");
+        return;
+    }
+    uint32_t fields = kAllFields;
+    auto fieldsParam = req->getOptionalParameter<std::string>("fields");
+    if (fieldsParam && !parseFields(*fieldsParam, kPersonFields, fields)) {
+        badRequest(std::move(callback), "fields must list id, first_name, last_name, hire_date, manager, department or job");
+        return;
+    }
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    // ranked by the name index, filled in from the snapshot; nothing goes to the database. The index
+    // is written as soon as a write is queued and the snapshot only once the writer thread publishes
+    // it, so a hit may be someone the pinned snapshot does not have yet; those are skipped, and a few
+    // extra hits make up for them
+    auto ids = orgGraphPtr->searchNames(query, static_cast<size_t>(limit) + kSearchSlack);
+    Json::Value ret{Json::arrayValue};
+    orgGraphPtr->readSnapshot([&ids, &ret, fields, limit](const OrgSnapshot &snapshot) {
+        for (auto id : ids) {
+            if (ret.size() == static_cast<Json::ArrayIndex>(limit)) {
+                break;
+            }
+            const auto *node = snapshot.graph.find(id);
+            if (node == nullptr) {
+                continue;
+            }
+            auto json = PersonDetails(*node, snapshot).toJson();
+            keepFields(json, kPersonFields, fields);
+            ret.append(std::move(json));
+        }
+    });
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void PersonsController::getChain(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
+    LOG_DEBUG << "getChain personId: "<< personId;
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    bool found = false;
+    Json::Value ret{Json::arrayValue};
+    orgGraphPtr->read([&found, &ret, personId](const OrgGraph &graph) {
+        found = graph.contains(personId);
+        for (const auto *manager : graph.chainOf(personId)) {
+            ret.append(manager->toJson());
+        }
+    });
+    if (!found) {
+        badRequest(std::move(callback), "resource not found", HttpStatusCode::k404NotFound);
+        return;
+    }
+
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void PersonsController::getCommonManager(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId, int otherPersonId) const {
+    LOG_DEBUG << "getCommonManager personId: "<< personId << " otherPersonId: " << otherPersonId;
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    Json::Value ret{};
+    orgGraphPtr->read([&ret, personId, otherPersonId](const OrgGraph &graph) {
+        const auto *manager = graph.commonManager(personId, otherPersonId);
+        if (manager != nullptr) {
+            ret = manager->toJson();
+        }
+    });
+    if (ret.isNull()) {
+        badRequest(std::move(callback), "resource not found", HttpStatusCode::k404NotFound);
+        return;
+    }
+
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void PersonsController::getStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId) const {
+    LOG_DEBUG << "getStats personId: "<< personId;
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    Json::Value ret{};
+    orgGraphPtr->read([&ret, personId](const OrgGraph &graph) {
+        auto index = graph.indexOf(personId);
+        if (index == OrgGraph::npos) {
+            return;
+        }
+        ret["id"] = personId;
+        ret["direct_reports"] = graph.directCount(index);
+        ret["total_reports"] = graph.totalCount(index);
+        ret["depth"] = graph.depthOf(index);
+    });
+    if (ret.isNull()) {
+        badRequest(std::move(callback), "resource not found", HttpStatusCode::k404NotFound);
+        return;
+    }
+
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
+}
+
+void PersonsController::getReportsTo(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int personId, int managerId) const {
+    LOG_DEBUG << "getReportsTo personId: "<< personId << " managerId: " << managerId;
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr == nullptr || !orgGraphPtr->isReady()) {
+        badRequest(std::move(callback), "org graph is not loaded yet", HttpStatusCode::k503ServiceUnavailable);
+        return;
+    }
+
+    bool found = false;
+    bool reportsTo = false;
+    orgGraphPtr->read([&found, &reportsTo, personId, managerId](const OrgGraph &graph) {
+        found = graph.contains(personId) && graph.contains(managerId);
+        reportsTo = graph.reportsTo(personId, managerId);
+    });
+    if (!found) {
+        badRequest(std::move(callback), "resource not found", HttpStatusCode::k404NotFound);
+        return;
+    }
+
+    Json::Value ret{};
+    ret["person_id"] = personId;
+    ret["manager_id"] = managerId;
+    ret["reports_to"] = reportsTo;
+    auto resp = HttpResponse::newHttpJsonResponse(ret);
+    resp->setStatusCode(HttpStatusCode::k200OK);
+    callback(resp);
 }
 
 PersonsController::PersonDetails::PersonDetails(const PersonInfo &personInfo) {
     id = personInfo.getValueOfId();
     first_name = personInfo.getValueOfFirstName();
     last_name = personInfo.getValueOfLastName();
-    hire_date = personInfo.getValueOfHireDate();
+    hire_date = personInfo.getValueOfHireDate().toDbStringLocal();
     Json::Value managerJson{};
     managerJson["id"] = personInfo.getValueOfManagerId();
     managerJson["full_name"] = personInfo.getValueOfManagerFullName();
@@ -275,12 +1577,254 @@ PersonsController::PersonDetails::PersonDetails(const PersonInfo &personInfo) {
     this->job = jobJson;
 }
 
+PersonsController::PersonDetails::PersonDetails(const Person &person, const OrgSnapshot &snapshot) :
+  PersonDetails(OrgGraphPlugin::toNode(person), snapshot) {}
+
+PersonsController::PersonDetails::PersonDetails(const OrgGraph::Node &node, const OrgSnapshot &snapshot) {
+    id = node.id;
+    first_name = node.firstName;
+    last_name = node.lastName;
+    hire_date = node.hireDate;
+    Json::Value managerJson{};
+    managerJson["id"] = node.managerId;
+    if (const auto *manager = snapshot.graph.find(node.managerId)) {
+        managerJson["full_name"] = manager->firstName + " " + manager->lastName;
+    } else {
+        managerJson["full_name"] = Json::Value();
+    }
+    this->manager = managerJson;
+    Json::Value departmentJson{};
+    departmentJson["id"] = node.departmentId;
+    auto department = snapshot.departments->find(node.departmentId);
+    if (department != snapshot.departments->end()) {
+        departmentJson["name"] = department->second.getValueOfName();
+    } else {
+        departmentJson["name"] = Json::Value();
+        stale = true;
+    }
+    this->department = departmentJson;
+    Json::Value jobJson{};
+    jobJson["id"] = node.jobId;
+    auto job = snapshot.jobs->find(node.jobId);
+    if (job != snapshot.jobs->end()) {
+        jobJson["title"] = job->second.getValueOfTitle();
+    } else {
+        jobJson["title"] = Json::Value();
+        stale = true;
+    }
+    this->job = jobJson;
+}
+
+auto PersonsController::personDetailsJson(const Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr, uint32_t fields) -> Json::Value {
+    Json::Value ret{};
+    if (fields != kAllFields) {
+        bool stale = false;
+        if (orgGraphPtr == nullptr) {
+            for (const auto &row : result) {
+                ret.append(sparsePersonJson(row, fields, nullptr, stale));
+            }
+        } else {
+            orgGraphPtr->readSnapshot([&ret, &result, &stale, fields](const OrgSnapshot &snapshot) {
+                for (const auto &row : result) {
+                    ret.append(sparsePersonJson(row, fields, &snapshot, stale));
+                }
+            });
+            if (stale) {
+                orgGraphPtr->refreshReferenceData();
+            }
+        }
+        if (stalePtr != nullptr) {
+            *stalePtr = stale;
+        }
+        return ret;
+    }
+
+    if (orgGraphPtr == nullptr) {
+        for (auto row : result) {
+            PersonInfo personInfo{row};
+            PersonDetails personDetails{personInfo};
+            ret.append(personDetails.toJson());
+        }
+        return ret;
+    }
+
+    bool stale = false;
+    orgGraphPtr->readSnapshot([&ret, &result, &stale](const OrgSnapshot &snapshot) {
+        for (auto row : result) {
+            PersonDetails personDetails{Person(row), snapshot};
+            stale = stale || personDetails.stale;
+            ret.append(personDetails.toJson());
+        }
+    });
+    if (stale) {
+        // a department or job was written behind our back; the next reads will have it
+        orgGraphPtr->refreshReferenceData();
+    }
+    if (stalePtr != nullptr) {
+        *stalePtr = stale;
+    }
+    return ret;
+}
+
+auto PersonsController::sparsePersonJson(const Row &row, uint32_t fields, const OrgSnapshot *snapshot, bool &stale) -> Json::Value {
+    Json::Value ret{};
+    if (fields & kId) {
+        ret["id"] = row["id"].as<int32_t>();
+    }
+    if (fields & kFirstName) {
+        ret["first_name"] = row["first_name"].as<std::string>();
+    }
+    if (fields & kLastName) {
+        ret["last_name"] = row["last_name"].as<std::string>();
+    }
+    if (fields & kHireDate) {
+        ret["hire_date"] = row["hire_date"].as<std::string>();
+    }
+    if (fields & kManager) {
+        auto managerId = row["manager_id"].as<int32_t>();
+        ret["manager"]["id"] = managerId;
+        if (snapshot == nullptr) {
+            ret["manager"]["full_name"] = row["manager_full_name"].as<std::string>();
+        } else if (const auto *manager = snapshot->graph.find(managerId)) {
+            ret["manager"]["full_name"] = manager->firstName + " " + manager->lastName;
+        } else {
+            ret["manager"]["full_name"] = Json::Value();
+        }
+    }
+    if (fields & kDepartment) {
+        auto departmentId = row["department_id"].as<int32_t>();
+        ret["department"]["id"] = departmentId;
+        if (snapshot == nullptr) {
+            ret["department"]["name"] = row["department_name"].as<std::string>();
+        } else if (auto department = snapshot->departments->find(departmentId); department != snapshot->departments->end()) {
+            ret["department"]["name"] = department->second.getValueOfName();
+        } else {
+            ret["department"]["name"] = Json::Value();
+            stale = true;
+        }
+    }
+    if (fields & kJob) {
+        auto jobId = row["job_id"].as<int32_t>();
+        ret["job"]["id"] = jobId;
+        if (snapshot == nullptr) {
+            ret["job"]["title"] = row["job_title"].as<std::string>();
+        } else if (auto job = snapshot->jobs->find(jobId); job != snapshot->jobs->end()) {
+            ret["job"]["title"] = job->second.getValueOfTitle();
+        } else {
+            ret["job"]["title"] = Json::Value();
+            stale = true;
+        }
+    }
+    return ret;
+}
+
+auto PersonsController::personDetailsBody(const Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr, uint32_t fields) -> std::string {
+    std::string body;
+    JsonWriter writer{body};
+    withPersonNames(orgGraphPtr, stalePtr, [&writer, &body, &result, fields](const OrgSnapshot *snapshot, bool &stale) {
+        if (result.empty()) {
+            // what an empty Json::Value array serializes to
+            body = "null";
+            return;
+        }
+        writer.beginArray();
+        size_t written = 0;
+        for (const auto &row : result) {
+            writePerson(writer, row, fields, snapshot, stale);
+            if (++written == 1) {
+                // size the page after its first row, so the body is grown about once
+                body.reserve(body.size() * result.size() * 5 / 4);
+            }
+        }
+        writer.endArray();
+    });
+    return body;
+}
+
+auto PersonsController::personDetailsBodies(const Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr, uint32_t fields)
+    -> std::vector<std::string> {
+    std::vector<std::string> bodies(result.size());
+    withPersonNames(orgGraphPtr, stalePtr, [&bodies, &result, fields](const OrgSnapshot *snapshot, bool &stale) {
+        size_t i = 0;
+        for (const auto &row : result) {
+            JsonWriter writer{bodies[i++]};
+            writePerson(writer, row, fields, snapshot, stale);
+        }
+    });
+    return bodies;
+}
+
+// The keys go out sorted, as jsoncpp writes them.
+void PersonsController::writePerson(JsonWriter &writer, const Row &row, uint32_t fields, const OrgSnapshot *snapshot, bool &stale) {
+    writer.beginObject();
+    if (fields & kDepartment) {
+        auto departmentId = row["department_id"].as<int32_t>();
+        writer.key("department");
+        writer.beginObject();
+        writer.member("id", departmentId);
+        writer.key("name");
+        if (snapshot == nullptr) {
+            writer.value(row["department_name"].as<std::string_view>());
+        } else if (auto department = snapshot->departments->find(departmentId); department != snapshot->departments->end()) {
+            writer.value(department->second.getValueOfName());
+        } else {
+            writer.null();
+            stale = true;
+        }
+        writer.endObject();
+    }
+    if (fields & kFirstName) {
+        writer.member("first_name", row["first_name"].as<std::string_view>());
+    }
+    if (fields & kHireDate) {
+        writer.member("hire_date", row["hire_date"].as<std::string_view>());
+    }
+    if (fields & kId) {
+        writer.member("id", row["id"].as<int32_t>());
+    }
+    if (fields & kJob) {
+        auto jobId = row["job_id"].as<int32_t>();
+        writer.key("job");
+        writer.beginObject();
+        writer.member("id", jobId);
+        writer.key("title");
+        if (snapshot == nullptr) {
+            writer.value(row["job_title"].as<std::string_view>());
+        } else if (auto job = snapshot->jobs->find(jobId); job != snapshot->jobs->end()) {
+            writer.value(job->second.getValueOfTitle());
+        } else {
+            writer.null();
+            stale = true;
+        }
+        writer.endObject();
+    }
+    if (fields & kLastName) {
+        writer.member("last_name", row["last_name"].as<std::string_view>());
+    }
+    if (fields & kManager) {
+        auto managerId = row["manager_id"].as<int32_t>();
+        writer.key("manager");
+        writer.beginObject();
+        writer.key("full_name");
+        if (snapshot == nullptr) {
+            writer.value(row["manager_full_name"].as<std::string_view>());
+        } else if (const auto *manager = snapshot->graph.find(managerId)) {
+            writer.value(manager->firstName + " " + manager->lastName);
+        } else {
+            writer.null();
+        }
+        writer.member("id", managerId);
+        writer.endObject();
+    }
+    writer.endObject();
+}
+
 auto PersonsController::PersonDetails::toJson() -> Json::Value {
     Json::Value ret{};
     ret["id"] = id;
     ret["first_name"] = first_name;
     ret["last_name"] = last_name;
-    ret["hire_date"] = hire_date.toDbStringLocal();
+    ret["hire_date"] = hire_date;
     ret["manager"] = manager;
     ret["department"] = department;
     ret["job"] = job;
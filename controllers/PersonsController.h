@@ -2,41 +2,99 @@
 
 #include <drogon/HttpController.h>
 #include <string>
+#include <vector>
 #include "../models/Person.h"
 #include "../models/PersonInfo.h"
+#include "../plugins/OrgGraph.h"
 
 using namespace drogon;
 using namespace drogon_model::org_chart;
 
+class JsonWriter;
+class OrgGraphPlugin;
+struct OrgSnapshot;
+
 class PersonsController : public drogon::HttpController<PersonsController> {
  public:
     METHOD_LIST_BEGIN
       ADD_METHOD_TO(PersonsController::get, "/persons", Get);
+      ADD_METHOD_TO(PersonsController::search, "/persons/search", Get);
       ADD_METHOD_TO(PersonsController::getOne, "/persons/{1}", Get);
       ADD_METHOD_TO(PersonsController::createOne, "/persons", Post);
+      ADD_METHOD_TO(PersonsController::reorg, "/persons/reorg", Post);
       ADD_METHOD_TO(PersonsController::updateOne, "/persons/{1}", Put);
       ADD_METHOD_TO(PersonsController::deleteOne, "/persons/{1}", Delete);
       ADD_METHOD_TO(PersonsController::getDirectReports, "/persons/{1}/reports", Get);
+      ADD_METHOD_TO(PersonsController::getSubtree, "/persons/{1}/subtree", Get);
+      ADD_METHOD_TO(PersonsController::getChain, "/persons/{1}/chain", Get);
+      ADD_METHOD_TO(PersonsController::getCommonManager, "/persons/{1}/common-manager/{2}", Get);
+      ADD_METHOD_TO(PersonsController::getStats, "/persons/{1}/stats", Get);
+      ADD_METHOD_TO(PersonsController::getReportsTo, "/persons/{1}/reports-to/{2}", Get);
     METHOD_LIST_END
 
+    // fields= bits, one per top-level key of a person
+    enum PersonField : uint32_t {
+        kId = 1u << 0,
+        kFirstName = 1u << 1,
+        kLastName = 1u << 2,
+        kHireDate = 1u << 3,
+        kManager = 1u << 4,
+        kDepartment = 1u << 5,
+        kJob = 1u << 6,
+        kAllFields = (1u << 7) - 1,
+    };
+
+    PersonsController();
+
+    /// Fills the person body cache from a snapshot, so the first reads after startup are served from memory.
+    static void warmBodyCache(const OrgSnapshot &snapshot);
+
     void get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr &)> &&callback) const;
     void getOne(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
+    void search(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const;
     void createOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, Person &&pPerson) const;
+    void reorg(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback) const;
     void updateOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId, Person &&pPerson) const;
     void deleteOne(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
     void getDirectReports(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
+    void getSubtree(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
+    void getChain(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
+    void getCommonManager(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId, int pOtherPersonId) const;
+    void getStats(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId) const;
+    void getReportsTo(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, int pPersonId, int pManagerId) const;
 
  private:
+    // GET /persons?ids=..., answered from the body cache where possible and with one query for the rest
+    void getByIds(const HttpRequestPtr &req, std::function<void(const HttpResponsePtr &)> &&callback, std::vector<int32_t> ids, uint32_t fields, uint32_t expand) const;
+
     struct PersonDetails {
         int id;
         std::string first_name;
         std::string last_name;
-        trantor::Date hire_date;
+        std::string hire_date;
         Json::Value manager;
         Json::Value department;
         Json::Value job;
+        // set when the snapshot lacked the person's department or job
+        bool stale{false};
         PersonDetails() {}
         explicit PersonDetails(const PersonInfo &personInfo);
+        PersonDetails(const Person &person, const OrgSnapshot &snapshot);
+        PersonDetails(const OrgGraph::Node &node, const OrgSnapshot &snapshot);
         Json::Value toJson();
     };
+
+    // Person rows stitched with names from the org snapshot, or PersonInfo rows when orgGraphPtr is null.
+    // stalePtr is set when a name was missing from the snapshot. With a sparse fieldset the rows only
+    // hold the columns personSelect() read for it and only the requested keys are written.
+    static Json::Value personDetailsJson(const drogon::orm::Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr = nullptr,
+                                         uint32_t fields = kAllFields);
+    static Json::Value sparsePersonJson(const drogon::orm::Row &row, uint32_t fields, const OrgSnapshot *snapshot, bool &stale);
+    // personDetailsJson() written straight from the rows, byte for byte what serializing it gives:
+    // the whole array as one body, or one body per row.
+    static std::string personDetailsBody(const drogon::orm::Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr = nullptr,
+                                         uint32_t fields = kAllFields);
+    static std::vector<std::string> personDetailsBodies(const drogon::orm::Result &result, OrgGraphPlugin *orgGraphPtr, bool *stalePtr = nullptr,
+                                                        uint32_t fields = kAllFields);
+    static void writePerson(JsonWriter &writer, const drogon::orm::Row &row, uint32_t fields, const OrgSnapshot *snapshot, bool &stale);
 };
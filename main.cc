@@ -1,8 +1,29 @@
 #include <drogon/drogon.h>
+#include "controllers/PersonsController.h"
+#include "plugins/OrgGraphPlugin.h"
+#include "utils/utils.h"
 int main() {
     LOG_DEBUG << "Load config file";
     drogon::app().loadConfigFile("../config.json");
 
+    // plugins exist once the app begins; warm the body cache as soon as the first snapshot is published
+    drogon::app().registerBeginningAdvice([]() {
+        if (auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>()) {
+            orgGraphPtr->onReady(&PersonsController::warmBodyCache);
+        }
+    });
+    // until then every request but the readiness probe is turned away, rather than stampeding the database
+    drogon::app().registerSyncAdvice([](const drogon::HttpRequestPtr &req) -> drogon::HttpResponsePtr {
+        auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+        if (orgGraphPtr == nullptr || orgGraphPtr->isReady() || req->path() == "/org/ready") {
+            return nullptr;
+        }
+        auto resp = drogon::HttpResponse::newHttpJsonResponse(makeErrResp("warming up"));
+        resp->setStatusCode(drogon::k503ServiceUnavailable);
+        resp->addHeader("Retry-After", "1");
+        return resp;
+    });
+
     LOG_DEBUG << "running on localhost:3000";
     drogon::app().run();
     return 0;
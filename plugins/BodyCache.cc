@@ -0,0 +1,94 @@
+#include "BodyCache.h"
+#include <algorithm>
+#include <iterator>
+
+BodyCache::BodyCache(size_t maxBytes, size_t shardCount) {
+    shardCount = std::max<size_t>(shardCount, 1);
+    shards_.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+    shardBytes_ = maxBytes / shardCount;
+}
+
+auto BodyCache::shardOf(int32_t key) const -> Shard & {
+    return *shards_[static_cast<uint32_t>(key) % shards_.size()];
+}
+
+void BodyCache::drop(Shard &shard, std::list<std::pair<int32_t, Body>>::iterator it) {
+    shard.bytes -= it->second->size();
+    shard.index.erase(it->first);
+    shard.lru.erase(it);
+}
+
+auto BodyCache::get(int32_t key) -> Body {
+    auto &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second->second;
+}
+
+auto BodyCache::ticket(int32_t key) const -> uint64_t {
+    return shardOf(key).invalidations.load(std::memory_order_acquire);
+}
+
+void BodyCache::put(int32_t key, Body body, uint64_t ticket) {
+    if (!body || body->size() > shardBytes_) {
+        return;
+    }
+    auto &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.invalidations.load(std::memory_order_relaxed) != ticket) {
+        return;
+    }
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        drop(shard, it->second);
+    }
+    while (!shard.lru.empty() && shard.bytes + body->size() > shardBytes_) {
+        drop(shard, std::prev(shard.lru.end()));
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.bytes += body->size();
+    shard.lru.emplace_front(key, std::move(body));
+    shard.index[key] = shard.lru.begin();
+}
+
+void BodyCache::erase(int32_t key) {
+    auto &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.invalidations.fetch_add(1, std::memory_order_release);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        drop(shard, it->second);
+    }
+}
+
+void BodyCache::clear() {
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->invalidations.fetch_add(1, std::memory_order_release);
+        shard->lru.clear();
+        shard->index.clear();
+        shard->bytes = 0;
+    }
+}
+
+auto BodyCache::stats() const -> Stats {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    for (const auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.entries += shard->index.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Sharded LRU of serialized response bodies keyed by entity id, bounded by
+ * the total size of the bodies it holds. Each shard has its own lock and an
+ * even share of the byte budget. A body is kept with its ETag, computed once
+ * when it is stored, so a conditional GET that hits never hashes it again.
+ *
+ * A reader that misses takes a ticket before going to the database and
+ * hands it back to put(); if the key was invalidated in between, the body
+ * it read may already be stale and is not stored.
+ */
+class BodyCache {
+ public:
+    struct Entry {
+        std::string body;
+        std::string etag;
+
+        auto size() const -> size_t { return body.size() + etag.size(); }
+    };
+    using Body = std::shared_ptr<const Entry>;
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+        size_t entries{0};
+        size_t bytes{0};
+    };
+
+    explicit BodyCache(size_t maxBytes, size_t shardCount = 16);
+
+    /// Returns nullptr on a miss.
+    auto get(int32_t key) -> Body;
+    auto ticket(int32_t key) const -> uint64_t;
+    void put(int32_t key, Body body, uint64_t ticket);
+    void erase(int32_t key);
+    void clear();
+    auto stats() const -> Stats;
+
+ private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<std::pair<int32_t, Body>> lru;  // most recently used first
+        std::unordered_map<int32_t, std::list<std::pair<int32_t, Body>>::iterator> index;
+        size_t bytes{0};
+        std::atomic<uint64_t> invalidations{0};
+    };
+
+    auto shardOf(int32_t key) const -> Shard &;
+    static void drop(Shard &shard, std::list<std::pair<int32_t, Body>>::iterator it);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shardBytes_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
@@ -0,0 +1,332 @@
+#include "ChangeListenerPlugin.h"
+#include "OrgGraphPlugin.h"
+#include "ResponseCachePlugin.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+using namespace drogon;
+using namespace drogon_model::org_chart;
+
+namespace {
+
+bool sameNode(const OrgGraph::Node &a, const OrgGraph::Node &b) {
+    return a.managerId == b.managerId && a.departmentId == b.departmentId && a.jobId == b.jobId &&
+           a.firstName == b.firstName && a.lastName == b.lastName && a.hireDate == b.hireDate;
+}
+
+void dropEverything(ResponseCachePlugin *cachePtr) {
+    if (cachePtr == nullptr) {
+        return;
+    }
+    cachePtr->reads().forget();
+    cachePtr->persons().clear();
+    cachePtr->missingPersons().clear();
+    cachePtr->missingDepartments().clear();
+    cachePtr->missingJobs().clear();
+}
+
+}  // namespace
+
+void ChangeListenerPlugin::initAndStart(const Json::Value &config) {
+    LOG_DEBUG << "ChangeListener initialized and Start";
+    channel_ = config.get("channel", "org_changes").asString();
+    dbClientName_ = config.get("db_client", "default").asString();
+    // LISTEN needs a connection of its own that stays open, so one is made to the database of the
+    // configured db client rather than taken from its pool
+    auto connectionInfo = config.get("connection_info", "").asString();
+    if (connectionInfo.empty()) {
+        auto dbClientPtr = drogon::app().getDbClient(dbClientName_);
+        if (dbClientPtr) {
+            connectionInfo = dbClientPtr->connectionInfo();
+        }
+    }
+    if (connectionInfo.empty()) {
+        LOG_WARN << "ChangeListener has no database to listen on, writes from other nodes will not be seen";
+        return;
+    }
+    listener_ = orm::DbListener::newPgListener(connectionInfo, drogon::app().getLoop());
+    if (!listener_) {
+        LOG_ERROR << "ChangeListener could not create a Postgres listener";
+        return;
+    }
+    listener_->listen(channel_, [this](std::string message) { receive(message); });
+
+    auto heartbeatSeconds = config.get("heartbeat_seconds", 2.0).asDouble();
+    if (heartbeatSeconds > 0) {
+        nodeId_ = drogon::utils::getUuid();
+        heartbeatTimer_ = drogon::app().getLoop()->runEvery(heartbeatSeconds, [this]() { heartbeat(); });
+    }
+}
+
+void ChangeListenerPlugin::shutdown() {
+    if (heartbeatTimer_ != 0) {
+        drogon::app().getLoop()->invalidateTimer(heartbeatTimer_);
+    }
+    if (listener_) {
+        listener_->unlisten(channel_);
+    }
+    LOG_DEBUG << "ChangeListener shut down";
+}
+
+auto ChangeListenerPlugin::applied() const -> uint64_t {
+    return applied_.load(std::memory_order_relaxed);
+}
+
+auto ChangeListenerPlugin::skipped() const -> uint64_t {
+    return skipped_.load(std::memory_order_relaxed);
+}
+
+auto ChangeListenerPlugin::resyncs() const -> uint64_t {
+    return resyncs_.load(std::memory_order_relaxed);
+}
+
+void ChangeListenerPlugin::heartbeat() {
+    // a ping has a whole beat to come back before it counts as lost
+    if (pingsSent_ > pingHeard_ + 1 && !lost_) {
+        LOG_WARN << "ChangeListener missed its ping " << pingHeard_ + 1 << ", changes may have been lost";
+        lost_ = true;
+    }
+    auto dbClientPtr = drogon::app().getDbClient(dbClientName_);
+    if (!dbClientPtr) {
+        return;
+    }
+    Json::Value ping;
+    ping["ping"] = nodeId_;
+    ping["seq"] = Json::UInt64(++pingsSent_);
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    dbClientPtr->execSqlAsync(
+        "select pg_notify($1, $2)", [](const orm::Result &) {},
+        [](const orm::DrogonDbException &e) { LOG_DEBUG << "ChangeListener ping failed: " << e.base().what(); },
+        channel_, Json::writeString(builder, ping));
+}
+
+void ChangeListenerPlugin::resync() {
+    LOG_WARN << "ChangeListener heard its ping again, reloading";
+    resyncs_.fetch_add(1, std::memory_order_relaxed);
+    // notifications held for the first load are covered by the reload too
+    held_.clear();
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    dropEverything(cachePtr);
+    if (auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>()) {
+        // bodies cached from the old snapshot while the reload runs go too
+        orgGraphPtr->reload([cachePtr]() { dropEverything(cachePtr); });
+    }
+}
+
+void ChangeListenerPlugin::receive(const std::string &message) {
+    Json::Value change;
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    std::istringstream in(message);
+    if (!Json::parseFromStream(builder, in, &change, &errors) || !change.isObject()) {
+        LOG_ERROR << "Malformed change notification: " << message;
+        return;
+    }
+    if (change.isMember("ping")) {
+        // other nodes' pings say nothing about this node's connection
+        if (change["ping"].asString() == nodeId_) {
+            pingHeard_ = std::max(pingHeard_, change["seq"].asUInt64());
+            if (lost_) {
+                lost_ = false;
+                resync();
+            }
+        }
+        return;
+    }
+
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (!held_.empty() || (orgGraphPtr != nullptr && !orgGraphPtr->isReady())) {
+        // keep order: once anything is held, everything after it waits too
+        held_.push_back(std::move(change));
+        if (held_.size() == 1) {
+            drainWhenReady();
+        }
+        return;
+    }
+    (apply(change) ? applied_ : skipped_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChangeListenerPlugin::drainWhenReady() {
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    if (orgGraphPtr != nullptr && !orgGraphPtr->isReady()) {
+        drogon::app().getLoop()->runAfter(0.1, [this]() { drainWhenReady(); });
+        return;
+    }
+    LOG_INFO << "Replaying " << held_.size() << " changes received while loading";
+    while (!held_.empty()) {
+        (apply(held_.front()) ? applied_ : skipped_).fetch_add(1, std::memory_order_relaxed);
+        held_.pop_front();
+    }
+}
+
+auto ChangeListenerPlugin::apply(const Json::Value &change) -> bool {
+    auto table = change["table"].asString();
+    auto op = change["op"].asString();
+    auto id = change["id"].asInt();
+    LOG_DEBUG << "Change on " << table << ": " << op << " " << id;
+    try {
+        if (table == "person") {
+            return applyPerson(op, id, change["row"]);
+        }
+        if (table == "department") {
+            return applyDepartment(op, id, change["row"]);
+        }
+        if (table == "job") {
+            return applyJob(op, id, change["row"]);
+        }
+    } catch (const std::exception &e) {
+        LOG_ERROR << "Could not apply change on " << table << " " << id << ": " << e.what();
+        // better to drop too much than to keep serving what changed
+        if (auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>()) {
+            cachePtr->reads().forget();
+            cachePtr->persons().clear();
+        }
+        return true;
+    }
+    LOG_WARN << "Change notification for unknown table " << table;
+    return false;
+}
+
+auto ChangeListenerPlugin::applyPerson(const std::string &op, int32_t id, const Json::Value &row) -> bool {
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    std::optional<Person> person;
+    if (op != "DELETE") {
+        person.emplace(row);
+    }
+
+    // the person's own body and its reports' bodies, which embed its name; the snapshot may already
+    // hold this change, so there is no telling whether the name changed and they always go
+    std::vector<int32_t> staleIds{id};
+    bool unchanged = false;
+    if (orgGraphPtr != nullptr) {
+        orgGraphPtr->read([&person, &staleIds, &unchanged, id](const OrgGraph &graph) {
+            const auto *node = graph.find(id);
+            if (node == nullptr) {
+                unchanged = !person;
+                return;
+            }
+            unchanged = person && sameNode(*node, OrgGraphPlugin::toNode(*person));
+            for (const auto *report : graph.directReports(id)) {
+                staleIds.push_back(report->id);
+            }
+        });
+    }
+
+    // once the change is published, so a read that misses the cache finds it in the snapshot
+    auto invalidate = [cachePtr, orgGraphPtr, staleIds = std::move(staleIds), insert = op == "INSERT", id]() {
+        if (cachePtr == nullptr) {
+            return;
+        }
+        // reads in flight first: one that takes its ticket after the erase must not join them
+        cachePtr->reads().forget();
+        if (orgGraphPtr == nullptr) {
+            cachePtr->persons().clear();
+        }
+        for (auto staleId : staleIds) {
+            cachePtr->persons().erase(staleId);
+        }
+        if (insert) {
+            cachePtr->missingPersons().erase(id);
+        }
+    };
+    if (orgGraphPtr != nullptr && !unchanged) {
+        if (person) {
+            orgGraphPtr->upsert(*person, std::move(invalidate));
+        } else {
+            orgGraphPtr->erase(id, std::move(invalidate));
+        }
+    } else {
+        invalidate();
+    }
+    return !unchanged;
+}
+
+auto ChangeListenerPlugin::applyDepartment(const std::string &op, int32_t id, const Json::Value &row) -> bool {
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    std::optional<Department> department;
+    if (op != "DELETE") {
+        department.emplace(row);
+    }
+
+    bool unchanged = false;
+    if (orgGraphPtr != nullptr) {
+        unchanged = orgGraphPtr->readSnapshot([&department, id](const OrgSnapshot &snapshot) {
+            auto it = snapshot.departments->find(id);
+            if (it == snapshot.departments->end()) {
+                return !department;
+            }
+            return department && it->second.getValueOfName() == department->getValueOfName();
+        });
+    }
+
+    // person bodies embed department names; like the controllers, drop them all rather than look for whose
+    auto invalidate = [cachePtr, insert = op == "INSERT", id]() {
+        if (cachePtr == nullptr) {
+            return;
+        }
+        cachePtr->reads().forget();
+        if (insert) {
+            cachePtr->missingDepartments().erase(id);
+        } else {
+            cachePtr->persons().clear();
+        }
+    };
+    if (orgGraphPtr != nullptr && !unchanged) {
+        if (department) {
+            orgGraphPtr->upsertDepartment(*department, std::move(invalidate));
+        } else {
+            orgGraphPtr->eraseDepartment(id, std::move(invalidate));
+        }
+    } else {
+        invalidate();
+    }
+    return !unchanged;
+}
+
+auto ChangeListenerPlugin::applyJob(const std::string &op, int32_t id, const Json::Value &row) -> bool {
+    auto *orgGraphPtr = drogon::app().getPlugin<OrgGraphPlugin>();
+    auto *cachePtr = drogon::app().getPlugin<ResponseCachePlugin>();
+    std::optional<Job> job;
+    if (op != "DELETE") {
+        job.emplace(row);
+    }
+
+    bool unchanged = false;
+    if (orgGraphPtr != nullptr) {
+        unchanged = orgGraphPtr->readSnapshot([&job, id](const OrgSnapshot &snapshot) {
+            auto it = snapshot.jobs->find(id);
+            if (it == snapshot.jobs->end()) {
+                return !job;
+            }
+            return job && it->second.getValueOfTitle() == job->getValueOfTitle();
+        });
+    }
+
+    auto invalidate = [cachePtr, insert = op == "INSERT", id]() {
+        if (cachePtr == nullptr) {
+            return;
+        }
+        cachePtr->reads().forget();
+        if (insert) {
+            cachePtr->missingJobs().erase(id);
+        } else {
+            cachePtr->persons().clear();
+        }
+    };
+    if (orgGraphPtr != nullptr && !unchanged) {
+        if (job) {
+            orgGraphPtr->upsertJob(*job, std::move(invalidate));
+        } else {
+            orgGraphPtr->eraseJob(id, std::move(invalidate));
+        }
+    } else {
+        invalidate();
+    }
+    return !unchanged;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <drogon/plugins/Plugin.h>
+#include <drogon/orm/DbListener.h>
+#include <trantor/net/EventLoop.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/**
+ * Keeps this node's caches in step with writes made through other nodes.
+ * Triggers on person, department and job (see scripts/create_db.sql) NOTIFY
+ * every changed row; for each one the org snapshot is patched from the row
+ * and only the cached bodies that embed it are dropped. A node also hears
+ * its own writes, which by then match the snapshot; the snapshot is left
+ * alone, but the bodies are still dropped, since a read may have cached one
+ * built from another node's older write in between.
+ *
+ * A department or job change drops every person body, as the controllers do.
+ *
+ * Notifications arriving before the org snapshot is ready are held and
+ * replayed once it is, as the initial load may have read those rows before
+ * they changed. The listener reconnects on its own after the connection
+ * drops, but whatever was notified meanwhile is lost; so every
+ * heartbeat_seconds the node notifies itself on the channel, and once a
+ * ping goes unheard for two beats, the next one heard reloads the snapshot and drops every
+ * cached body and miss. Everything runs on the main event loop.
+ */
+class ChangeListenerPlugin : public drogon::Plugin<ChangeListenerPlugin> {
+ public:
+    virtual void initAndStart(const Json::Value &config) override;
+    virtual void shutdown() override;
+
+    /// Notifications that changed something here.
+    auto applied() const -> uint64_t;
+    /// Notifications whose row the snapshot already had, usually this node's own writes.
+    auto skipped() const -> uint64_t;
+    /// Reloads after the connection was lost.
+    auto resyncs() const -> uint64_t;
+
+ private:
+    void receive(const std::string &message);
+    void drainWhenReady();
+    void heartbeat();
+    void resync();
+    auto apply(const Json::Value &change) -> bool;
+    auto applyPerson(const std::string &op, int32_t id, const Json::Value &row) -> bool;
+    auto applyDepartment(const std::string &op, int32_t id, const Json::Value &row) -> bool;
+    auto applyJob(const std::string &op, int32_t id, const Json::Value &row) -> bool;
+
+    std::string channel_;
+    std::string dbClientName_;
+    std::string nodeId_;
+    drogon::orm::DbListenerPtr listener_;
+    trantor::TimerId heartbeatTimer_{0};
+    uint64_t pingsSent_{0};
+    uint64_t pingHeard_{0};
+    bool lost_{false};
+    std::deque<Json::Value> held_;
+    std::atomic<uint64_t> applied_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> resyncs_{0};
+};
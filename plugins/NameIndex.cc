@@ -0,0 +1,307 @@
+#include "NameIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <tuple>
+#include <unordered_set>
+
+namespace {
+
+auto words(const std::string &text) -> std::vector<std::string> {
+    std::vector<std::string> ret;
+    std::string word;
+    for (char c : text) {
+        auto byte = static_cast<unsigned char>(c);
+        if (byte >= 0x80 || std::isalnum(byte)) {
+            word += static_cast<char>(std::tolower(byte));
+        } else if (!word.empty()) {
+            ret.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        ret.push_back(std::move(word));
+    }
+    return ret;
+}
+
+auto trigrams(const std::string &text) -> std::vector<uint32_t> {
+    std::vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        grams.push_back(static_cast<uint32_t>(static_cast<unsigned char>(text[i])) << 16 |
+                        static_cast<uint32_t>(static_cast<unsigned char>(text[i + 1])) << 8 |
+                        static_cast<uint32_t>(static_cast<unsigned char>(text[i + 2])));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+auto startsWith(const std::string &word, const std::string &prefix) -> bool {
+    return word.compare(0, prefix.size(), prefix) == 0;
+}
+
+// 0 for the whole word, 1 for a prefix, 2 inside it (long query words only), 3 for no match
+auto tierOf(const std::string &word, const std::string &queryWord) -> uint32_t {
+    if (word == queryWord) {
+        return 0;
+    }
+    if (startsWith(word, queryWord)) {
+        return 1;
+    }
+    if (queryWord.size() >= 3 && word.find(queryWord) != std::string::npos) {
+        return 2;
+    }
+    return 3;
+}
+
+}  // namespace
+
+NameIndex::NameIndex(const std::vector<OrgGraph::Node> &nodes) {
+    // append everything, then sort each list once instead of inserting in order
+    entries_.reserve(nodes.size());
+    for (const auto &node : nodes) {
+        auto entry = makeEntry(node.firstName, node.lastName);
+        for (const auto &word : entry.words) {
+            vocabulary_[word].emplace_back(entry.length, node.id);
+        }
+        entries_.insert_or_assign(node.id, std::move(entry));
+    }
+    for (auto &word : vocabulary_) {
+        std::sort(word.second.begin(), word.second.end());
+        for (auto gram : trigrams(word.first)) {
+            trigrams_[gram].push_back(&word);
+        }
+    }
+    for (auto &[gram, words] : trigrams_) {
+        std::sort(words.begin(), words.end());
+    }
+}
+
+auto NameIndex::makeEntry(const std::string &firstName, const std::string &lastName) -> Entry {
+    Entry entry;
+    entry.words = words(firstName + " " + lastName);
+    for (const auto &word : entry.words) {
+        entry.length += static_cast<uint32_t>(word.size());
+    }
+    // a person is listed once per distinct word
+    std::sort(entry.words.begin(), entry.words.end());
+    entry.words.erase(std::unique(entry.words.begin(), entry.words.end()), entry.words.end());
+    return entry;
+}
+
+void NameIndex::upsert(int32_t id, const std::string &firstName, const std::string &lastName) {
+    auto entry = makeEntry(firstName, lastName);
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        if (it->second.words == entry.words && it->second.length == entry.length) {
+            return;
+        }
+        unlink(id, it->second);
+    }
+    link(id, entry);
+    entries_.insert_or_assign(id, std::move(entry));
+}
+
+void NameIndex::erase(int32_t id) {
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        return;
+    }
+    unlink(id, it->second);
+    entries_.erase(it);
+}
+
+auto NameIndex::size() const -> size_t {
+    return entries_.size();
+}
+
+void NameIndex::link(int32_t id, const Entry &entry) {
+    Key key{entry.length, id};
+    for (const auto &text : entry.words) {
+        auto [word, added] = vocabulary_.try_emplace(text);
+        if (added) {
+            addWord(*word);
+        }
+        auto &persons = word->second;
+        persons.insert(std::lower_bound(persons.begin(), persons.end(), key), key);
+    }
+}
+
+void NameIndex::unlink(int32_t id, const Entry &entry) {
+    Key key{entry.length, id};
+    for (const auto &text : entry.words) {
+        auto word = vocabulary_.find(text);
+        if (word == vocabulary_.end()) {
+            continue;
+        }
+        auto &persons = word->second;
+        auto at = std::lower_bound(persons.begin(), persons.end(), key);
+        if (at != persons.end() && *at == key) {
+            persons.erase(at);
+        }
+        if (persons.empty()) {
+            dropWord(*word);
+            vocabulary_.erase(word);
+        }
+    }
+}
+
+void NameIndex::addWord(const Word &word) {
+    for (auto gram : trigrams(word.first)) {
+        auto &words = trigrams_[gram];
+        words.insert(std::lower_bound(words.begin(), words.end(), &word), &word);
+    }
+}
+
+void NameIndex::dropWord(const Word &word) {
+    for (auto gram : trigrams(word.first)) {
+        auto it = trigrams_.find(gram);
+        if (it == trigrams_.end()) {
+            continue;
+        }
+        auto &words = it->second;
+        auto at = std::lower_bound(words.begin(), words.end(), &word);
+        if (at != words.end() && *at == &word) {
+            words.erase(at);
+        }
+        if (words.empty()) {
+            trigrams_.erase(it);
+        }
+    }
+}
+
+auto NameIndex::matches(const std::string &queryWord) const -> std::vector<Match> {
+    std::vector<Match> ret;
+    for (auto it = vocabulary_.lower_bound(queryWord); it != vocabulary_.end() && startsWith(it->first, queryWord); ++it) {
+        ret.push_back({tierOf(it->first, queryWord), &it->second});
+    }
+    // a short word is too unselective to match mid-word, so it only matches word starts
+    if (queryWord.size() < 3) {
+        return ret;
+    }
+
+    std::vector<const std::vector<const Word *> *> lists;
+    for (auto gram : trigrams(queryWord)) {
+        auto it = trigrams_.find(gram);
+        if (it == trigrams_.end()) {
+            return ret;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto *a, const auto *b) { return a->size() < b->size(); });
+    for (const auto *word : *lists.front()) {
+        bool inAll = std::all_of(lists.begin() + 1, lists.end(),
+                                 [word](const auto *list) { return std::binary_search(list->begin(), list->end(), word); });
+        // trigrams can match at different positions, so the word itself is checked; prefixes are already in
+        if (inAll && tierOf(word->first, queryWord) == 2) {
+            ret.push_back({2, &word->second});
+        }
+    }
+    return ret;
+}
+
+auto NameIndex::search(const std::string &query, size_t limit) const -> std::vector<int32_t> {
+    auto queryWords = words(query);
+    if (queryWords.empty() || limit == 0) {
+        return {};
+    }
+    std::sort(queryWords.begin(), queryWords.end());
+    queryWords.erase(std::unique(queryWords.begin(), queryWords.end()), queryWords.end());
+
+    // candidates come from the word matching the fewest persons; the other words add at least
+    // their best tier to every candidate's score
+    std::vector<Match> driver;
+    size_t driverIndex = 0;
+    size_t driverSize = SIZE_MAX;
+    uint32_t driverTier = 0;
+    uint32_t floor = 0;
+    for (size_t i = 0; i < queryWords.size(); ++i) {
+        auto found = matches(queryWords[i]);
+        size_t total = 0;
+        uint32_t minTier = 3;
+        for (const auto &match : found) {
+            total += match.persons->size();
+            minTier = std::min(minTier, match.tier);
+        }
+        if (total == 0) {
+            return {};
+        }
+        floor += minTier;
+        if (total < driverSize) {
+            driver = std::move(found);
+            driverIndex = i;
+            driverSize = total;
+            driverTier = minTier;
+        }
+    }
+    floor -= driverTier;
+
+    // Candidates are visited by driver tier, then in rank order within it, by merging the lists
+    // of that tier. best is a max-heap of the limit best (score, key) so far; once its worst can't
+    // be beaten by anything left, the search stops, which for one word is after limit persons.
+    using Ranked = std::pair<uint32_t, Key>;
+    using Head = std::tuple<Key, const Key *, const Key *>;
+    std::vector<Ranked> best;
+    std::unordered_set<int32_t> seen;
+    for (uint32_t tier = 0; tier < 3; ++tier) {
+        std::vector<Head> heads;
+        for (const auto &match : driver) {
+            if (match.tier == tier) {
+                const auto &persons = *match.persons;
+                heads.emplace_back(persons.front(), persons.data(), persons.data() + persons.size());
+            }
+        }
+        std::make_heap(heads.begin(), heads.end(), std::greater<Head>());
+        while (!heads.empty()) {
+            std::pop_heap(heads.begin(), heads.end(), std::greater<Head>());
+            auto [key, at, end] = heads.back();
+            heads.pop_back();
+            if (++at != end) {
+                heads.emplace_back(*at, at, end);
+                std::push_heap(heads.begin(), heads.end(), std::greater<Head>());
+            }
+            if (best.size() == limit && best.front() < Ranked{tier + floor, key}) {
+                break;
+            }
+            if (!seen.insert(key.second).second) {
+                continue;
+            }
+
+            auto score = tier;
+            if (queryWords.size() > 1) {
+                const auto &entry = entries_.at(key.second);
+                for (size_t i = 0; i < queryWords.size() && score != UINT32_MAX; ++i) {
+                    if (i == driverIndex) {
+                        continue;
+                    }
+                    uint32_t wordTier = 3;
+                    for (const auto &word : entry.words) {
+                        wordTier = std::min(wordTier, tierOf(word, queryWords[i]));
+                    }
+                    score = wordTier == 3 ? UINT32_MAX : score + wordTier;
+                }
+            }
+            if (score == UINT32_MAX) {
+                continue;
+            }
+            best.emplace_back(score, key);
+            std::push_heap(best.begin(), best.end());
+            if (best.size() > limit) {
+                std::pop_heap(best.begin(), best.end());
+                best.pop_back();
+            }
+        }
+        if (best.size() == limit && best.front().first <= tier + floor) {
+            break;
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    std::vector<int32_t> ret;
+    ret.reserve(best.size());
+    for (const auto &ranked : best) {
+        ret.push_back(ranked.second.second);
+    }
+    return ret;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "OrgGraph.h"
+
+/**
+ * Name index for type-ahead person search.
+ *
+ * Names are lowercased (ASCII only; other bytes are kept as they are) and
+ * split into words. The vocabulary of distinct words, far smaller than the
+ * org, is kept sorted, so the words a query word prefixes are one range of
+ * it, and is trigram indexed for query words of three or more characters,
+ * which also match inside a word. Each word keeps the persons having it
+ * sorted by (name length, id), the order results are ranked in.
+ *
+ * A one word query merges the person lists of the matching words, whole
+ * words first, then prefixes, then the rest, and stops after limit persons,
+ * so its cost does not grow with how many persons match. Longer queries
+ * check everyone matching their most selective word against the others.
+ *
+ * Not synchronized; the owner serializes writes against searches.
+ */
+class NameIndex {
+ public:
+    NameIndex() = default;
+    explicit NameIndex(const std::vector<OrgGraph::Node> &nodes);
+
+    void upsert(int32_t id, const std::string &firstName, const std::string &lastName);
+    void erase(int32_t id);
+    auto size() const -> size_t;
+
+    /**
+     * Up to limit ids whose names match every word of query, best first:
+     * whole-word matches before word prefixes before matches inside a word,
+     * then shorter names, then lower ids.
+     */
+    auto search(const std::string &query, size_t limit) const -> std::vector<int32_t>;
+
+ private:
+    // (name length, id), the order persons are ranked in among equal matches
+    using Key = std::pair<uint32_t, int32_t>;
+
+    struct Entry {
+        std::vector<std::string> words;
+        uint32_t length{0};
+    };
+
+    using Word = std::map<std::string, std::vector<Key>>::value_type;
+
+    // a vocabulary word matching a query word: 0 the whole word, 1 a prefix, 2 inside it
+    struct Match {
+        uint32_t tier{0};
+        const std::vector<Key> *persons{nullptr};
+    };
+
+    static auto makeEntry(const std::string &firstName, const std::string &lastName) -> Entry;
+    void link(int32_t id, const Entry &entry);
+    void unlink(int32_t id, const Entry &entry);
+    void addWord(const Word &word);
+    void dropWord(const Word &word);
+    auto matches(const std::string &queryWord) const -> std::vector<Match>;
+
+    std::unordered_map<int32_t, Entry> entries_;
+    std::map<std::string, std::vector<Key>> vocabulary_;
+    // map nodes stay put, so the trigram lists point at them, sorted by address
+    std::unordered_map<uint32_t, std::vector<const Word *>> trigrams_;
+};
@@ -0,0 +1,72 @@
+#include "NegativeCache.h"
+
+NegativeCache::NegativeCache(Clock::duration ttl, size_t maxEntries) : ttl_{ttl}, maxEntries_{maxEntries} {}
+
+auto NegativeCache::contains(int32_t id, Clock::time_point now) -> bool {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = expiries_.find(id);
+    if (it == expiries_.end() || it->second <= now) {
+        return false;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+auto NegativeCache::ticket() const -> uint64_t {
+    return erasures_.load(std::memory_order_acquire);
+}
+
+void NegativeCache::add(int32_t id, uint64_t ticket, Clock::time_point now) {
+    if (maxEntries_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (erasures_.load(std::memory_order_relaxed) != ticket) {
+        return;
+    }
+    expire(now);
+    while (expiries_.size() >= maxEntries_) {
+        auto [oldest, expiry] = order_.front();
+        order_.pop_front();
+        auto it = expiries_.find(oldest);
+        if (it != expiries_.end() && it->second == expiry) {
+            expiries_.erase(it);
+        }
+    }
+    expiries_[id] = now + ttl_;
+    order_.emplace_back(id, now + ttl_);
+}
+
+void NegativeCache::erase(int32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    erasures_.fetch_add(1, std::memory_order_release);
+    // the queue entry goes once it reaches the front
+    expiries_.erase(id);
+}
+
+void NegativeCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    erasures_.fetch_add(1, std::memory_order_release);
+    expiries_.clear();
+    order_.clear();
+}
+
+auto NegativeCache::size() const -> size_t {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return expiries_.size();
+}
+
+auto NegativeCache::hits() const -> uint64_t {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+void NegativeCache::expire(Clock::time_point now) {
+    while (!order_.empty() && (order_.front().second <= now || order_.size() > 2 * maxEntries_)) {
+        auto [id, expiry] = order_.front();
+        order_.pop_front();
+        auto it = expiries_.find(id);
+        if (it != expiries_.end() && it->second == expiry) {
+            expiries_.erase(it);
+        }
+    }
+}
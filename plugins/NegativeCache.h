@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Remembers ids that a lookup found missing, for a short while, so repeated
+ * requests for them are answered without a query. Entries expire after ttl
+ * and the oldest are dropped once maxEntries are held.
+ *
+ * Like BodyCache, a reader takes a ticket before its query and hands it back
+ * to add(); if any id was erased in between (i.e. something was created), the
+ * miss it saw may already be outdated and is not remembered.
+ */
+class NegativeCache {
+ public:
+    using Clock = std::chrono::steady_clock;
+
+    NegativeCache(Clock::duration ttl, size_t maxEntries);
+
+    auto contains(int32_t id, Clock::time_point now = Clock::now()) -> bool;
+    auto ticket() const -> uint64_t;
+    void add(int32_t id, uint64_t ticket, Clock::time_point now = Clock::now());
+    void erase(int32_t id);
+    void clear();
+    auto size() const -> size_t;
+    /// Lookups answered from the cache.
+    auto hits() const -> uint64_t;
+
+ private:
+    void expire(Clock::time_point now);
+
+    Clock::duration ttl_;
+    size_t maxEntries_;
+    mutable std::mutex mutex_;
+    std::unordered_map<int32_t, Clock::time_point> expiries_;
+    // insertion order, which with a fixed ttl is also expiry order; may hold outdated duplicates
+    std::deque<std::pair<int32_t, Clock::time_point>> order_;
+    std::atomic<uint64_t> erasures_{0};
+    std::atomic<uint64_t> hits_{0};
+};
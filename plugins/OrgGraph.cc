@@ -0,0 +1,739 @@
+#include "OrgGraph.h"
+#include <algorithm>
+
+Json::Value OrgGraph::Node::toJson() const {
+    Json::Value ret{};
+    ret["id"] = id;
+    ret["job_id"] = jobId;
+    ret["department_id"] = departmentId;
+    ret["manager_id"] = managerId;
+    ret["first_name"] = firstName;
+    ret["last_name"] = lastName;
+    ret["hire_date"] = hireDate;
+    return ret;
+}
+
+OrgGraph::OrgGraph(std::vector<Node> nodes) : nodes_{std::move(nodes)} {
+    alive_.assign(nodes_.size(), true);
+    rebuild();
+}
+
+auto OrgGraph::size() const -> size_t {
+    return indexes_.size();
+}
+
+auto OrgGraph::contains(int32_t id) const -> bool {
+    return indexes_.find(id) != indexes_.end();
+}
+
+auto OrgGraph::indexOf(int32_t id) const -> uint32_t {
+    auto it = indexes_.find(id);
+    return it == indexes_.end() ? npos : it->second;
+}
+
+auto OrgGraph::node(uint32_t index) const -> const Node & {
+    return nodes_[index];
+}
+
+auto OrgGraph::find(int32_t id) const -> const Node * {
+    auto index = indexOf(id);
+    return index == npos ? nullptr : &nodes_[index];
+}
+
+auto OrgGraph::managerOf(uint32_t index) const -> uint32_t {
+    return managers_[index];
+}
+
+auto OrgGraph::reportsOf(uint32_t index) const -> ReportRange {
+    const auto &slice = slices_[index];
+    return {reports_.data() + slice.first, reports_.data() + slice.first + slice.size};
+}
+
+auto OrgGraph::directReports(int32_t id) const -> std::vector<const Node *> {
+    std::vector<const Node *> ret;
+    auto index = indexOf(id);
+    if (index == npos) {
+        return ret;
+    }
+    auto range = reportsOf(index);
+    ret.reserve(range.second - range.first);
+    for (auto it = range.first; it != range.second; ++it) {
+        ret.push_back(&nodes_[*it]);
+    }
+    return ret;
+}
+
+auto OrgGraph::depthOf(uint32_t index) const -> uint32_t {
+    return depths_[index];
+}
+
+auto OrgGraph::ancestorAt(uint32_t index, uint32_t levelsUp) const -> uint32_t {
+    for (size_t k = 0; levelsUp > 0 && index != npos; ++k, levelsUp >>= 1) {
+        if (k >= ancestors_.size()) {
+            return npos;
+        }
+        if (levelsUp & 1) {
+            index = ancestors_[k][index];
+        }
+    }
+    return index;
+}
+
+auto OrgGraph::directCount(uint32_t index) const -> uint32_t {
+    return slices_[index].size;
+}
+
+auto OrgGraph::totalCount(uint32_t index) const -> uint32_t {
+    return totals_[index];
+}
+
+auto OrgGraph::departmentStats(int32_t departmentId) const -> const DepartmentStats * {
+    auto it = departments_.find(departmentId);
+    return it == departments_.end() ? nullptr : &it->second;
+}
+
+auto OrgGraph::chainOf(int32_t id) const -> std::vector<const Node *> {
+    std::vector<const Node *> ret;
+    auto index = indexOf(id);
+    if (index == npos) {
+        return ret;
+    }
+    ret.reserve(depths_[index]);
+    for (auto manager = ancestors_[0][index]; manager != npos; manager = ancestors_[0][manager]) {
+        ret.push_back(&nodes_[manager]);
+    }
+    return ret;
+}
+
+auto OrgGraph::commonManager(int32_t a, int32_t b) const -> const Node * {
+    auto x = indexOf(a);
+    auto y = indexOf(b);
+    if (x == npos || y == npos) {
+        return nullptr;
+    }
+    if (depths_[x] < depths_[y]) {
+        std::swap(x, y);
+    }
+    x = ancestorAt(x, depths_[x] - depths_[y]);
+    if (x == y) {
+        return &nodes_[x];
+    }
+    for (size_t k = ancestors_.size(); k-- > 0;) {
+        if (ancestors_[k][x] != ancestors_[k][y]) {
+            x = ancestors_[k][x];
+            y = ancestors_[k][y];
+        }
+    }
+    auto manager = ancestors_[0][x];
+    return manager == npos || manager != ancestors_[0][y] ? nullptr : &nodes_[manager];
+}
+
+auto OrgGraph::reportsTo(int32_t id, int32_t managerId) const -> bool {
+    auto index = indexOf(id);
+    auto manager = indexOf(managerId);
+    if (index == npos || manager == npos || index == manager) {
+        return false;
+    }
+    if (labelsFresh_) {
+        auto enter = enter_[manager];
+        return enter != npos && enter_[index] != npos && enter_[index] > enter && enter_[index] <= enter + totals_[manager];
+    }
+    if (depths_[index] <= depths_[manager]) {
+        return false;
+    }
+    return ancestorAt(index, depths_[index] - depths_[manager]) == manager;
+}
+
+auto OrgGraph::labelsFresh() const -> bool {
+    return labelsFresh_;
+}
+
+auto OrgGraph::orgOf(uint32_t index) const -> ReportRange {
+    if (enter_[index] == npos) {
+        return {nullptr, nullptr};
+    }
+    const auto *first = order_.data() + enter_[index] + 1;
+    return {first, first + totals_[index]};
+}
+
+void OrgGraph::relabel() {
+    if (reports_.size() > 2 * linked_ + 1024) {
+        compact();
+    }
+    order_.clear();
+    order_.reserve(indexes_.size());
+    enter_.assign(nodes_.size(), npos);
+    levels_.clear();
+    auto label = [this](uint32_t index) {
+        enter_[index] = static_cast<uint32_t>(order_.size());
+        order_.push_back(index);
+        if (levels_.size() <= depths_[index]) {
+            levels_.resize(depths_[index] + 1);
+        }
+        levels_[depths_[index]].push_back(index);
+    };
+
+    std::vector<ReportRange> stack;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!alive_[i] || managers_[i] != npos) {
+            continue;
+        }
+        label(static_cast<uint32_t>(i));
+        stack.push_back(reportsOf(static_cast<uint32_t>(i)));
+        while (!stack.empty()) {
+            auto &top = stack.back();
+            if (top.first == top.second) {
+                stack.pop_back();
+                continue;
+            }
+            auto index = *top.first++;
+            label(index);
+            stack.push_back(reportsOf(index));
+        }
+    }
+    labelsFresh_ = true;
+}
+
+auto OrgGraph::reportsAtLevel(int32_t id, uint32_t levelsBelow) const -> std::vector<const Node *> {
+    std::vector<const Node *> reports;
+    auto index = indexOf(id);
+    if (index == npos || levelsBelow == 0) {
+        return reports;
+    }
+    if (!labelsFresh_) {
+        walkSubtree(id, std::nullopt, levelsBelow, [&reports, levelsBelow](const Node &node, uint32_t depth) {
+            if (depth == levelsBelow) {
+                reports.push_back(&node);
+            }
+            return true;
+        });
+        return reports;
+    }
+
+    auto depth = static_cast<size_t>(depths_[index]) + levelsBelow;
+    if (depth >= levels_.size() || totals_[index] == 0) {
+        return reports;
+    }
+    // the level is in pre-order, so the persons below index form one slice of it
+    const auto &level = levels_[depth];
+    auto enter = enter_[index];
+    auto last = enter + totals_[index];
+    auto first = std::upper_bound(level.begin(), level.end(), enter, [this](uint32_t position, uint32_t other) {
+        return position < enter_[other];
+    });
+    for (auto it = first; it != level.end() && enter_[*it] <= last; ++it) {
+        reports.push_back(&nodes_[*it]);
+    }
+    return reports;
+}
+
+auto OrgGraph::atDepth(uint32_t depth) const -> std::vector<const Node *> {
+    std::vector<const Node *> persons;
+    if (!labelsFresh_) {
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (alive_[i] && depths_[i] == depth) {
+                persons.push_back(&nodes_[i]);
+            }
+        }
+        return persons;
+    }
+    if (depth < levels_.size()) {
+        persons.reserve(levels_[depth].size());
+        for (auto index : levels_[depth]) {
+            persons.push_back(&nodes_[index]);
+        }
+    }
+    return persons;
+}
+
+auto OrgGraph::startWalk(int32_t rootId, std::optional<int32_t> afterId, uint32_t maxDepth, std::vector<Frame> &frames) const -> bool {
+    auto root = indexOf(rootId);
+    if (root == npos) {
+        return false;
+    }
+    if (!afterId) {
+        auto range = reportsOf(root);
+        if (maxDepth > 0 && range.first != range.second) {
+            frames.push_back({range.first, range.second, 1});
+        }
+        return true;
+    }
+
+    auto after = indexOf(*afterId);
+    if (after == npos || after == root) {
+        return false;
+    }
+
+    // climb to the root, then replay the frames the walk had open when it emitted `after`
+    std::vector<uint32_t> path{after};
+    while (path.back() != root) {
+        auto manager = managers_[path.back()];
+        if (manager == npos || path.size() > indexes_.size()) {
+            return false;
+        }
+        path.push_back(manager);
+    }
+
+    for (size_t k = path.size() - 1; k > 0 && path.size() - k <= maxDepth; --k) {
+        auto range = reportsOf(path[k]);
+        auto id = nodes_[path[k - 1]].id;
+        auto next = std::upper_bound(range.first, range.second, id, [this](int32_t value, uint32_t report) {
+            return value < nodes_[report].id;
+        });
+        frames.push_back({next, range.second, static_cast<uint32_t>(path.size() - k)});
+    }
+    auto depth = static_cast<uint32_t>(path.size() - 1);
+    auto range = reportsOf(after);
+    if (depth < maxDepth && range.first != range.second) {
+        frames.push_back({range.first, range.second, depth + 1});
+    }
+    return true;
+}
+
+auto OrgGraph::findCycle(const std::vector<Move> &moves) const -> std::optional<int32_t> {
+    std::unordered_map<int32_t, int32_t> overlay;
+    for (const auto &move : moves) {
+        if (move.managerId) {
+            overlay[move.personId] = *move.managerId;
+        }
+    }
+    auto managerOfId = [this, &overlay](int32_t id) -> std::optional<int32_t> {
+        auto it = overlay.find(id);
+        if (it != overlay.end()) {
+            return it->second;
+        }
+        const auto *node = find(id);
+        if (node == nullptr) {
+            return std::nullopt;
+        }
+        return node->managerId;
+    };
+
+    auto maxSteps = indexes_.size() + overlay.size();
+    for (const auto &entry : overlay) {
+        // managing oneself makes a top of the org, not a loop
+        if (entry.second == entry.first) {
+            continue;
+        }
+        auto current = entry.second;
+        for (size_t steps = 0; steps <= maxSteps; ++steps) {
+            if (current == entry.first) {
+                return entry.first;
+            }
+            auto manager = managerOfId(current);
+            if (!manager || *manager == current) {
+                break;
+            }
+            current = *manager;
+        }
+    }
+    return std::nullopt;
+}
+
+void OrgGraph::applyMoves(const std::vector<Move> &moves) {
+    for (const auto &move : moves) {
+        const auto *current = find(move.personId);
+        if (current == nullptr) {
+            continue;
+        }
+        auto node = *current;
+        if (move.managerId) {
+            node.managerId = *move.managerId;
+        }
+        if (move.departmentId) {
+            node.departmentId = *move.departmentId;
+        }
+        upsert(node);
+    }
+}
+
+void OrgGraph::upsert(const Node &node) {
+    auto it = indexes_.find(node.id);
+    if (it == indexes_.end()) {
+        auto index = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(node);
+        alive_.push_back(true);
+        managers_.push_back(npos);
+        slices_.emplace_back();
+        depths_.push_back(0);
+        for (auto &level : ancestors_) {
+            level.push_back(npos);
+        }
+        totals_.push_back(0);
+        enter_.push_back(npos);
+        labelsFresh_ = false;
+        ++departments_[node.departmentId].headcount;
+        indexes_[node.id] = index;
+
+        auto manager = resolveManager(index);
+        managers_[index] = manager;
+        if (manager != npos) {
+            link(index, manager);
+        } else if (node.managerId != node.id) {
+            wait(index);
+        }
+        refreshAncestors(index);
+        // someone may already be waiting for this person as their manager
+        adopt(index);
+        return;
+    }
+
+    auto index = it->second;
+    auto previous = managers_[index];
+    auto previousManagerId = nodes_[index].managerId;
+    bool wasWaiting = previous == npos && previousManagerId != nodes_[index].id;
+    if (nodes_[index].departmentId != node.departmentId) {
+        moveDepartment(index, nodes_[index].departmentId, node.departmentId);
+    }
+    nodes_[index] = node;
+
+    auto manager = resolveManager(index);
+    if (manager != previous) {
+        if (previous != npos) {
+            unlink(index, previous);
+        }
+        if (manager != npos) {
+            link(index, manager);
+        }
+        managers_[index] = manager;
+        refreshAncestors(index);
+    }
+    bool isWaiting = manager == npos && node.managerId != node.id;
+    bool sameManagerId = previousManagerId == node.managerId;
+    if (wasWaiting && !(isWaiting && sameManagerId)) {
+        stopWaiting(index, previousManagerId);
+    }
+    if (isWaiting && !(wasWaiting && sameManagerId)) {
+        wait(index);
+    }
+}
+
+auto OrgGraph::erase(int32_t id) -> bool {
+    auto it = indexes_.find(id);
+    if (it == indexes_.end()) {
+        return false;
+    }
+
+    auto index = it->second;
+    auto manager = managers_[index];
+    if (manager != npos) {
+        unlink(index, manager);
+    } else if (nodes_[index].managerId != id) {
+        stopWaiting(index, nodes_[index].managerId);
+    }
+    auto departmentId = nodes_[index].departmentId;
+    auto &stats = departments_[departmentId];
+    if (directCount(index) > 0) {
+        --stats.managers;
+        stats.directReports -= directCount(index);
+    }
+    if (--stats.headcount == 0) {
+        departments_.erase(departmentId);
+    }
+
+    // the database refuses to delete a manager with reports, but stay consistent if it happens
+    auto range = reportsOf(index);
+    if (range.first != range.second) {
+        std::vector<uint32_t> detached(range.first, range.second);
+        linked_ -= detached.size();
+        slices_[index].size = 0;
+        for (auto report : detached) {
+            managers_[report] = npos;
+            wait(report);
+        }
+        for (auto report : detached) {
+            refreshAncestors(report);
+        }
+    }
+
+    indexes_.erase(it);
+    alive_[index] = false;
+    labelsFresh_ = false;
+    ++tombstones_;
+    if (tombstones_ > 1024 && tombstones_ * 4 > nodes_.size()) {
+        rebuild();
+    }
+    return true;
+}
+
+void OrgGraph::rebuild() {
+    std::vector<Node> live;
+    live.reserve(nodes_.size() - tombstones_);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (alive_[i]) {
+            live.push_back(std::move(nodes_[i]));
+        }
+    }
+    std::sort(live.begin(), live.end(), [](const Node &a, const Node &b) { return a.id < b.id; });
+    nodes_ = std::move(live);
+    alive_.assign(nodes_.size(), true);
+    tombstones_ = 0;
+
+    indexes_.clear();
+    indexes_.reserve(nodes_.size());
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        indexes_[nodes_[i].id] = static_cast<uint32_t>(i);
+    }
+
+    // counting sort of (manager, report) pairs; nodes_ is ordered by id so every slice ends up sorted too
+    waiting_.clear();
+    managers_.assign(nodes_.size(), npos);
+    slices_.assign(nodes_.size(), Slice{});
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        auto manager = resolveManager(static_cast<uint32_t>(i));
+        managers_[i] = manager;
+        if (manager != npos) {
+            ++slices_[manager].capacity;
+        } else if (nodes_[i].managerId != nodes_[i].id) {
+            wait(static_cast<uint32_t>(i));
+        }
+    }
+    uint32_t first = 0;
+    for (auto &slice : slices_) {
+        slice.first = first;
+        first += slice.capacity;
+    }
+    reports_.assign(first, 0);
+    linked_ = first;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (managers_[i] != npos) {
+            auto &slice = slices_[managers_[i]];
+            reports_[slice.first + slice.size++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    rebuildRollups(rebuildAncestors());
+    relabel();
+}
+
+auto OrgGraph::rebuildAncestors() -> std::vector<uint32_t> {
+    auto count = nodes_.size();
+    depths_.assign(count, 0);
+    ancestors_.assign(1, std::vector<uint32_t>(count, npos));
+
+    // breadth-first from the top of the org, so every manager is placed before their reports
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (alive_[i] && managers_[i] == npos) {
+            order.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    uint32_t maxDepth = 0;
+    for (size_t head = 0; head < order.size(); ++head) {
+        auto index = order[head];
+        auto range = reportsOf(index);
+        for (auto it = range.first; it != range.second; ++it) {
+            depths_[*it] = depths_[index] + 1;
+            ancestors_[0][*it] = index;
+            maxDepth = std::max(maxDepth, depths_[*it]);
+            order.push_back(*it);
+        }
+    }
+    // whoever was not reached sits on a manager loop; they stay detached at depth 0
+
+    ensureLevels(maxDepth);
+    return order;
+}
+
+void OrgGraph::rebuildRollups(const std::vector<uint32_t> &order) {
+    // reverse breadth-first order visits every report before their manager
+    totals_.assign(nodes_.size(), 0);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        auto manager = managers_[*it];
+        if (manager != npos) {
+            totals_[manager] += 1 + totals_[*it];
+        }
+    }
+
+    departments_.clear();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!alive_[i]) {
+            continue;
+        }
+        auto &stats = departments_[nodes_[i].departmentId];
+        ++stats.headcount;
+        auto direct = directCount(static_cast<uint32_t>(i));
+        if (direct > 0) {
+            ++stats.managers;
+            stats.directReports += direct;
+        }
+    }
+}
+
+void OrgGraph::addToChain(uint32_t manager, uint32_t stop, int64_t delta) {
+    for (size_t steps = 0; manager != npos && manager != stop && steps <= nodes_.size(); manager = managers_[manager], ++steps) {
+        totals_[manager] = static_cast<uint32_t>(totals_[manager] + delta);
+    }
+}
+
+void OrgGraph::moveDepartment(uint32_t index, int32_t from, int32_t to) {
+    auto direct = directCount(index);
+    auto &source = departments_[from];
+    if (direct > 0) {
+        --source.managers;
+        source.directReports -= direct;
+    }
+    if (--source.headcount == 0) {
+        departments_.erase(from);
+    }
+
+    auto &target = departments_[to];
+    ++target.headcount;
+    if (direct > 0) {
+        ++target.managers;
+        target.directReports += direct;
+    }
+}
+
+void OrgGraph::refreshAncestors(uint32_t index) {
+    // a loop can only close through `index`, since that is the only edge that changed
+    for (auto manager = managers_[index], steps = 0u; manager != npos && steps <= depths_.size(); manager = managers_[manager], ++steps) {
+        if (manager == index) {
+            depths_[index] = 0;
+            for (auto &level : ancestors_) {
+                level[index] = npos;
+            }
+            return;
+        }
+    }
+
+    std::vector<uint32_t> order{index};
+    for (size_t head = 0; head < order.size(); ++head) {
+        auto current = order[head];
+        auto manager = managers_[current];
+        auto depth = manager == npos ? 0 : depths_[manager] + 1;
+        depths_[current] = depth;
+        ensureLevels(depth);
+        ancestors_[0][current] = manager;
+        for (size_t k = 1; k < ancestors_.size(); ++k) {
+            auto half = ancestors_[k - 1][current];
+            ancestors_[k][current] = half == npos ? npos : ancestors_[k - 1][half];
+        }
+        auto range = reportsOf(current);
+        order.insert(order.end(), range.first, range.second);
+    }
+}
+
+void OrgGraph::ensureLevels(uint32_t depth) {
+    // jumps of up to 2^levels - 1 must be possible
+    size_t levels = 1;
+    while (levels < 32 && (depth >> levels) != 0) {
+        ++levels;
+    }
+    if (ancestors_.empty()) {
+        ancestors_.emplace_back(nodes_.size(), npos);
+    }
+    while (ancestors_.size() < levels) {
+        auto k = ancestors_.size();
+        std::vector<uint32_t> level(nodes_.size(), npos);
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            auto half = ancestors_[k - 1][i];
+            level[i] = half == npos ? npos : ancestors_[k - 1][half];
+        }
+        ancestors_.push_back(std::move(level));
+    }
+}
+
+auto OrgGraph::resolveManager(uint32_t index) const -> uint32_t {
+    const auto &node = nodes_[index];
+    if (node.managerId == node.id) {
+        return npos;
+    }
+    auto it = indexes_.find(node.managerId);
+    return it == indexes_.end() ? npos : it->second;
+}
+
+void OrgGraph::link(uint32_t index, uint32_t manager) {
+    auto &slice = slices_[manager];
+    if (slice.size == slice.capacity) {
+        // out of room: move to the end with twice as much, leaving a hole for compact()
+        auto capacity = std::max<uint32_t>(4, slice.capacity * 2);
+        auto first = static_cast<uint32_t>(reports_.size());
+        reports_.resize(reports_.size() + capacity);
+        std::copy_n(reports_.begin() + slice.first, slice.size, reports_.begin() + first);
+        slice.first = first;
+        slice.capacity = capacity;
+    }
+    auto first = reports_.begin() + slice.first;
+    auto last = first + slice.size;
+    auto id = nodes_[index].id;
+    auto pos = std::lower_bound(first, last, id, [this](uint32_t report, int32_t value) {
+        return nodes_[report].id < value;
+    });
+    std::copy_backward(pos, last, last + 1);
+    *pos = index;
+    ++slice.size;
+    ++linked_;
+    labelsFresh_ = false;
+
+    auto &stats = departments_[nodes_[manager].departmentId];
+    if (directCount(manager) == 1) {
+        ++stats.managers;
+    }
+    ++stats.directReports;
+    addToChain(manager, index, 1 + static_cast<int64_t>(totals_[index]));
+}
+
+void OrgGraph::unlink(uint32_t index, uint32_t manager) {
+    auto &slice = slices_[manager];
+    auto first = reports_.begin() + slice.first;
+    auto last = first + slice.size;
+    auto pos = std::find(first, last, index);
+    if (pos == last) {
+        return;
+    }
+    std::copy(pos + 1, last, pos);
+    --slice.size;
+    --linked_;
+    labelsFresh_ = false;
+
+    auto &stats = departments_[nodes_[manager].departmentId];
+    if (directCount(manager) == 0) {
+        --stats.managers;
+    }
+    --stats.directReports;
+    addToChain(manager, index, -1 - static_cast<int64_t>(totals_[index]));
+}
+
+void OrgGraph::compact() {
+    std::vector<uint32_t> reports;
+    reports.reserve(linked_);
+    for (auto &slice : slices_) {
+        auto first = static_cast<uint32_t>(reports.size());
+        reports.insert(reports.end(), reports_.begin() + slice.first, reports_.begin() + slice.first + slice.size);
+        slice.first = first;
+        slice.capacity = slice.size;
+    }
+    reports_ = std::move(reports);
+}
+
+void OrgGraph::wait(uint32_t index) {
+    waiting_[nodes_[index].managerId].push_back(index);
+}
+
+void OrgGraph::stopWaiting(uint32_t index, int32_t managerId) {
+    auto it = waiting_.find(managerId);
+    if (it == waiting_.end()) {
+        return;
+    }
+    auto &indexes = it->second;
+    indexes.erase(std::remove(indexes.begin(), indexes.end(), index), indexes.end());
+    if (indexes.empty()) {
+        waiting_.erase(it);
+    }
+}
+
+void OrgGraph::adopt(uint32_t manager) {
+    auto it = waiting_.find(nodes_[manager].id);
+    if (it == waiting_.end()) {
+        return;
+    }
+    auto reports = std::move(it->second);
+    waiting_.erase(it);
+    for (auto report : reports) {
+        managers_[report] = manager;
+        link(report, manager);
+        refreshAncestors(report);
+    }
+}
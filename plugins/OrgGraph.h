@@ -0,0 +1,202 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * In-memory view of the person.manager_id hierarchy.
+ *
+ * Persons are stored at dense indexes and their direct reports are kept in
+ * one flat array: the reports of index i are a slice of reports_, sorted by
+ * person id, with some room to grow. A slice that runs out of room moves to
+ * the end of the array with twice the room; relabel() squeezes out the holes
+ * once they outweigh the reports. Erased persons are tombstoned and dropped
+ * by the next rebuild. Persons whose manager is not known yet wait under
+ * that manager's id and are linked when the manager arrives.
+ *
+ * Ancestors are indexed by binary lifting: ancestors_[k][i] is the 2^k-th
+ * manager above i. A manager change only refreshes the moved subtree.
+ *
+ * Headcount rollups (everyone below a person, per-department counts) are
+ * adjusted along the manager chain on every write. A write therefore costs
+ * O(depth + direct reports of the managers involved + the moved subtree),
+ * never a pass over the whole org, and rollups are O(1) to read.
+ *
+ * relabel() lays the org out in pre-order: everyone below i then occupies
+ * order_[enter_[i] + 1, enter_[i] + 1 + totals_[i]). It also buckets persons
+ * by depth in the same order, so everyone k levels below i is one binary
+ * searched slice of levels_[depth + k]. Writes only mark the labels stale;
+ * the owner relabels once per batch of writes and the label-based queries
+ * fall back to the ancestor index or a walk in between.
+ */
+class OrgGraph {
+ public:
+    struct Node {
+        int32_t id{0};
+        int32_t managerId{0};
+        int32_t departmentId{0};
+        int32_t jobId{0};
+        std::string firstName;
+        std::string lastName;
+        std::string hireDate;
+        Json::Value toJson() const;
+    };
+
+    struct Move {
+        int32_t personId{0};
+        std::optional<int32_t> managerId;
+        std::optional<int32_t> departmentId;
+    };
+
+    struct DepartmentStats {
+        uint32_t headcount{0};
+        // persons in the department with at least one report, and how many reports they have
+        uint32_t managers{0};
+        uint32_t directReports{0};
+    };
+
+    using ReportRange = std::pair<const uint32_t *, const uint32_t *>;
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    OrgGraph() = default;
+    explicit OrgGraph(std::vector<Node> nodes);
+
+    auto size() const -> size_t;
+    auto contains(int32_t id) const -> bool;
+    auto indexOf(int32_t id) const -> uint32_t;
+    auto node(uint32_t index) const -> const Node &;
+    auto find(int32_t id) const -> const Node *;
+    auto managerOf(uint32_t index) const -> uint32_t;
+    auto reportsOf(uint32_t index) const -> ReportRange;
+    auto directReports(int32_t id) const -> std::vector<const Node *>;
+    auto depthOf(uint32_t index) const -> uint32_t;
+    auto ancestorAt(uint32_t index, uint32_t levelsUp) const -> uint32_t;
+    auto directCount(uint32_t index) const -> uint32_t;
+    auto totalCount(uint32_t index) const -> uint32_t;
+    auto departmentStats(int32_t departmentId) const -> const DepartmentStats *;
+
+    /// Managers of id from the direct manager up to the top of the org.
+    auto chainOf(int32_t id) const -> std::vector<const Node *>;
+    /// Lowest person both a and b roll up to (a person counts as part of their own org).
+    auto commonManager(int32_t a, int32_t b) const -> const Node *;
+
+    /// True when id reports to managerId, directly or not.
+    auto reportsTo(int32_t id, int32_t managerId) const -> bool;
+    auto labelsFresh() const -> bool;
+    /// Everyone below index as one contiguous pre-order range; only valid while labelsFresh().
+    auto orgOf(uint32_t index) const -> ReportRange;
+    void relabel();
+
+    /// Everyone exactly levelsBelow levels below id (1 = direct reports), in pre-order.
+    auto reportsAtLevel(int32_t id, uint32_t levelsBelow) const -> std::vector<const Node *>;
+    /// Everyone at org depth depth (0 = the top of the org), in pre-order.
+    auto atDepth(uint32_t depth) const -> std::vector<const Node *>;
+
+    /// Visits every person once, in no particular order.
+    template <typename Visitor>
+    void forEachNode(Visitor &&visitor) const {
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            if (alive_[i]) {
+                visitor(nodes_[i]);
+            }
+        }
+    }
+
+    /**
+     * Depth-first pre-order walk over everyone below rootId, down to maxDepth
+     * levels (direct reports are at depth 1). With afterId the walk resumes
+     * right after that person, so a cursor stays valid across writes.
+     * The visitor gets (node, depth) and returns false to stop.
+     * Returns false if rootId is unknown or afterId is not below it.
+     */
+    template <typename Visitor>
+    auto walkSubtree(int32_t rootId, std::optional<int32_t> afterId, uint32_t maxDepth, Visitor &&visitor) const -> bool {
+        std::vector<Frame> frames;
+        if (!startWalk(rootId, afterId, maxDepth, frames)) {
+            return false;
+        }
+        while (!frames.empty()) {
+            auto &top = frames.back();
+            if (top.next == top.end) {
+                frames.pop_back();
+                continue;
+            }
+            auto index = *top.next++;
+            auto depth = top.depth;
+            if (!visitor(nodes_[index], depth)) {
+                return true;
+            }
+            auto range = reportsOf(index);
+            if (depth < maxDepth && range.first != range.second) {
+                frames.push_back({range.first, range.second, depth + 1});
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns the first person whose move would put them below themselves
+     * once every move is applied, checking each move in O(depth). A move to
+     * oneself makes that person a top of the org and is never a loop.
+     */
+    auto findCycle(const std::vector<Move> &moves) const -> std::optional<int32_t>;
+
+    void upsert(const Node &node);
+    auto erase(int32_t id) -> bool;
+    void applyMoves(const std::vector<Move> &moves);
+
+ private:
+    struct Frame {
+        const uint32_t *next;
+        const uint32_t *end;
+        uint32_t depth;
+    };
+
+    struct Slice {
+        uint32_t first{0};
+        uint32_t size{0};
+        uint32_t capacity{0};
+    };
+
+    auto startWalk(int32_t rootId, std::optional<int32_t> afterId, uint32_t maxDepth, std::vector<Frame> &frames) const -> bool;
+    void rebuild();
+    auto rebuildAncestors() -> std::vector<uint32_t>;
+    void rebuildRollups(const std::vector<uint32_t> &order);
+    void addToChain(uint32_t manager, uint32_t stop, int64_t delta);
+    void moveDepartment(uint32_t index, int32_t from, int32_t to);
+    void refreshAncestors(uint32_t index);
+    void ensureLevels(uint32_t depth);
+    auto resolveManager(uint32_t index) const -> uint32_t;
+    void link(uint32_t index, uint32_t manager);
+    void unlink(uint32_t index, uint32_t manager);
+    void compact();
+    void wait(uint32_t index);
+    void stopWaiting(uint32_t index, int32_t managerId);
+    void adopt(uint32_t manager);
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> managers_;
+    std::vector<bool> alive_;
+    std::unordered_map<int32_t, uint32_t> indexes_;
+    std::vector<Slice> slices_;
+    std::vector<uint32_t> reports_;
+    // reports_ entries in use; the rest is room to grow or holes left by moved slices
+    size_t linked_{0};
+    std::vector<uint32_t> depths_;
+    std::vector<std::vector<uint32_t>> ancestors_;
+    std::vector<uint32_t> totals_;
+    std::vector<uint32_t> order_;
+    std::vector<uint32_t> enter_;
+    std::vector<std::vector<uint32_t>> levels_;
+    bool labelsFresh_{false};
+    std::unordered_map<int32_t, DepartmentStats> departments_;
+    size_t tombstones_{0};
+    // manager id to the persons waiting for that manager to be added
+    std::unordered_map<int32_t, std::vector<uint32_t>> waiting_;
+};
@@ -0,0 +1,329 @@
+#include "OrgGraphPlugin.h"
+#include <drogon/drogon.h>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+using namespace drogon;
+using namespace drogon::orm;
+using namespace drogon_model::org_chart;
+
+namespace {
+
+struct ThreadPin {
+    std::shared_ptr<const OrgSnapshot> snapshot;
+    uint32_t depth{0};
+};
+
+// the plugin is a singleton, so one pin per thread is enough
+ThreadPin &threadPin() {
+    thread_local ThreadPin pin;
+    return pin;
+}
+
+}  // namespace
+
+OrgGraphPlugin::Pin::Pin(const OrgGraphPlugin &plugin) {
+    auto &pin = threadPin();
+    if (pin.depth++ == 0 && (!pin.snapshot || pin.snapshot->epoch != plugin.epoch_.load(std::memory_order_acquire))) {
+        pin.snapshot = std::atomic_load_explicit(&plugin.current_, std::memory_order_acquire);
+    }
+    snapshot_ = pin.snapshot.get();
+}
+
+OrgGraphPlugin::Pin::~Pin() {
+    --threadPin().depth;
+}
+
+void OrgGraphPlugin::initAndStart(const Json::Value &config) {
+    LOG_DEBUG << "OrgGraph initialized and Start";
+    retrySeconds_ = config.get("retry_seconds", 5).asDouble();
+    writer_.run();
+    // db clients are only usable once the main loop runs
+    drogon::app().getLoop()->queueInLoop([this]() { reload(); });
+}
+
+void OrgGraphPlugin::shutdown() {
+    LOG_DEBUG << "OrgGraph shut down";
+}
+
+auto OrgGraphPlugin::isReady() const -> bool {
+    return ready_.load(std::memory_order_acquire);
+}
+
+auto OrgGraphPlugin::epoch() const -> uint64_t {
+    return epoch_.load(std::memory_order_acquire);
+}
+
+void OrgGraphPlugin::onReady(ReadyHook hook) {
+    {
+        std::lock_guard<std::mutex> lock(hooksMutex_);
+        if (!ready_.load(std::memory_order_acquire)) {
+            readyHooks_.push_back(std::move(hook));
+            return;
+        }
+    }
+    hook(*snapshot());
+}
+
+void OrgGraphPlugin::reload(Published reloaded) {
+    auto dbClientPtr = drogon::app().getDbClient();
+    auto fresh = std::make_shared<OrgSnapshot>();
+    auto started = std::chrono::steady_clock::now();
+    auto elapsedMs = [started]() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    };
+    auto failed = [this, reloaded](const DrogonDbException &e) {
+        LOG_ERROR << "OrgGraph load failed: " << e.base().what();
+        if (!ready_.load(std::memory_order_acquire) || reloaded) {
+            LOG_INFO << "OrgGraph retrying the load in " << retrySeconds_ << "s";
+            drogon::app().getLoop()->runAfter(retrySeconds_, [this, reloaded]() { reload(reloaded); });
+        }
+    };
+    LOG_INFO << "OrgGraph loading departments, jobs and persons";
+    *dbClientPtr << "select * from department"
+                 >> [this, dbClientPtr, fresh, elapsedMs, failed, reloaded](const Result &departments)
+                   {
+                      auto loaded = std::make_shared<OrgSnapshot::Departments>();
+                      for (const auto &row : departments) {
+                          Department department(row);
+                          loaded->emplace(department.getValueOfId(), department);
+                      }
+                      fresh->departments = std::move(loaded);
+                      LOG_INFO << "OrgGraph loaded " << departments.size() << " departments after " << elapsedMs() << " ms";
+                      *dbClientPtr << "select * from job"
+                                   >> [this, dbClientPtr, fresh, elapsedMs, failed, reloaded](const Result &jobs)
+                                     {
+                                        auto loaded = std::make_shared<OrgSnapshot::Jobs>();
+                                        for (const auto &row : jobs) {
+                                            Job job(row);
+                                            loaded->emplace(job.getValueOfId(), job);
+                                        }
+                                        fresh->jobs = std::move(loaded);
+                                        LOG_INFO << "OrgGraph loaded " << jobs.size() << " jobs after " << elapsedMs() << " ms";
+                                        *dbClientPtr << "select * from person order by id"
+                                                     >> [this, fresh, elapsedMs, reloaded](const Result &persons)
+                                                       {
+                                                          std::vector<OrgGraph::Node> nodes;
+                                                          nodes.reserve(persons.size());
+                                                          for (const auto &row : persons) {
+                                                              nodes.push_back(toNode(Person(row)));
+                                                          }
+                                                          LOG_INFO << "OrgGraph loaded " << persons.size() << " persons after " << elapsedMs() << " ms";
+                                                          NameIndex names(nodes);
+                                                          {
+                                                              std::unique_lock<std::shared_mutex> lock(namesMutex_);
+                                                              names_ = std::move(names);
+                                                          }
+                                                          LOG_INFO << "OrgGraph indexed names after " << elapsedMs() << " ms";
+                                                          fresh->graph = OrgGraph(std::move(nodes));
+                                                          std::vector<Published> published;
+                                                          {
+                                                              std::lock_guard<std::mutex> lock(writerMutex_);
+                                                              published = publishLocked(fresh);
+                                                          }
+                                                          for (const auto &callback : published) {
+                                                              callback();
+                                                          }
+                                                          LOG_INFO << "OrgGraph indexed " << fresh->graph.size() << " persons after " << elapsedMs() << " ms";
+                                                          runReadyHooks(*fresh);
+                                                          LOG_INFO << "OrgGraph ready after " << elapsedMs() << " ms";
+                                                          if (reloaded) {
+                                                              reloaded();
+                                                          }
+                                                       }
+                                                     >> failed;
+                                     }
+                                   >> failed;
+                   }
+                 >> failed;
+}
+
+void OrgGraphPlugin::runReadyHooks(const OrgSnapshot &snapshot) {
+    // hooks registered while these run are taken in the next round; ready_ flips with the list empty
+    while (true) {
+        std::vector<ReadyHook> hooks;
+        {
+            std::lock_guard<std::mutex> lock(hooksMutex_);
+            if (readyHooks_.empty()) {
+                ready_.store(true, std::memory_order_release);
+                return;
+            }
+            hooks.swap(readyHooks_);
+        }
+        for (const auto &hook : hooks) {
+            hook(snapshot);
+        }
+    }
+}
+
+void OrgGraphPlugin::upsert(const Person &person, Published published) {
+    publish([node = toNode(person)](OrgSnapshot &snapshot) { snapshot.graph.upsert(node); }, std::move(published));
+    std::unique_lock<std::shared_mutex> lock(namesMutex_);
+    names_.upsert(person.getValueOfId(), person.getValueOfFirstName(), person.getValueOfLastName());
+}
+
+void OrgGraphPlugin::erase(int32_t personId, Published published) {
+    publish([personId](OrgSnapshot &snapshot) { snapshot.graph.erase(personId); }, std::move(published));
+    std::unique_lock<std::shared_mutex> lock(namesMutex_);
+    names_.erase(personId);
+}
+
+auto OrgGraphPlugin::searchNames(const std::string &query, size_t limit) const -> std::vector<int32_t> {
+    std::shared_lock<std::shared_mutex> lock(namesMutex_);
+    return names_.search(query, limit);
+}
+
+void OrgGraphPlugin::applyMoves(const std::vector<OrgGraph::Move> &moves, Published published) {
+    publish([moves](OrgSnapshot &snapshot) { snapshot.graph.applyMoves(moves); }, std::move(published));
+}
+
+// the maps are shared with older versions, so a write changes a copy of the one it touches
+void OrgGraphPlugin::upsertDepartment(const Department &department, Published published) {
+    publish([department](OrgSnapshot &snapshot) {
+        auto departments = std::make_shared<OrgSnapshot::Departments>(*snapshot.departments);
+        departments->insert_or_assign(department.getValueOfId(), department);
+        snapshot.departments = std::move(departments);
+    }, std::move(published));
+}
+
+void OrgGraphPlugin::eraseDepartment(int32_t departmentId, Published published) {
+    publish([departmentId](OrgSnapshot &snapshot) {
+        auto departments = std::make_shared<OrgSnapshot::Departments>(*snapshot.departments);
+        departments->erase(departmentId);
+        snapshot.departments = std::move(departments);
+    }, std::move(published));
+}
+
+void OrgGraphPlugin::upsertJob(const Job &job, Published published) {
+    publish([job](OrgSnapshot &snapshot) {
+        auto jobs = std::make_shared<OrgSnapshot::Jobs>(*snapshot.jobs);
+        jobs->insert_or_assign(job.getValueOfId(), job);
+        snapshot.jobs = std::move(jobs);
+    }, std::move(published));
+}
+
+void OrgGraphPlugin::eraseJob(int32_t jobId, Published published) {
+    publish([jobId](OrgSnapshot &snapshot) {
+        auto jobs = std::make_shared<OrgSnapshot::Jobs>(*snapshot.jobs);
+        jobs->erase(jobId);
+        snapshot.jobs = std::move(jobs);
+    }, std::move(published));
+}
+
+void OrgGraphPlugin::refreshReferenceData() {
+    if (refreshing_.exchange(true)) {
+        return;
+    }
+    auto dbClientPtr = drogon::app().getDbClient();
+    *dbClientPtr << "select * from department"
+                 >> [this, dbClientPtr](const Result &departmentRows)
+                   {
+                      auto departments = std::make_shared<OrgSnapshot::Departments>();
+                      for (const auto &row : departmentRows) {
+                          Department department(row);
+                          departments->emplace(department.getValueOfId(), department);
+                      }
+                      *dbClientPtr << "select * from job"
+                                   >> [this, departments = std::move(departments)](const Result &jobRows)
+                                     {
+                                        auto jobs = std::make_shared<OrgSnapshot::Jobs>();
+                                        for (const auto &row : jobRows) {
+                                            Job job(row);
+                                            jobs->emplace(job.getValueOfId(), job);
+                                        }
+                                        LOG_INFO << "OrgGraph reloaded " << departments->size() << " departments, " << jobs->size() << " jobs";
+                                        publish([departments, jobs = std::move(jobs)](OrgSnapshot &snapshot) {
+                                            snapshot.departments = departments;
+                                            snapshot.jobs = jobs;
+                                        }, {});
+                                        refreshing_.store(false);
+                                     }
+                                   >> [this](const DrogonDbException &e)
+                                     {
+                                        refreshing_.store(false);
+                                        LOG_ERROR << "OrgGraph reference data reload failed: " << e.base().what();
+                                     };
+                   }
+                 >> [this](const DrogonDbException &e)
+                   {
+                      refreshing_.store(false);
+                      LOG_ERROR << "OrgGraph reference data reload failed: " << e.base().what();
+                   };
+}
+
+auto OrgGraphPlugin::snapshot() const -> std::shared_ptr<const OrgSnapshot> {
+    return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+}
+
+void OrgGraphPlugin::publish(Mutation mutation, Published published) {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    pending_.push_back({std::move(mutation), std::move(published)});
+    if (!flushQueued_) {
+        flushQueued_ = true;
+        writer_.getLoop()->queueInLoop([this]() { flush(); });
+    }
+}
+
+void OrgGraphPlugin::flush() {
+    std::vector<Published> published;
+    {
+        std::lock_guard<std::mutex> lock(writerMutex_);
+        {
+            // a reload may already have taken the batch
+            std::lock_guard<std::mutex> pendingLock(pendingMutex_);
+            if (pending_.empty()) {
+                flushQueued_ = false;
+                return;
+            }
+        }
+        published = publishLocked(std::make_shared<OrgSnapshot>(*snapshot()));
+    }
+    for (const auto &callback : published) {
+        callback();
+    }
+}
+
+auto OrgGraphPlugin::publishLocked(std::shared_ptr<OrgSnapshot> next) -> std::vector<Published> {
+    std::vector<Pending> batch;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        batch.swap(pending_);
+        flushQueued_ = false;
+    }
+    std::vector<Published> published;
+    for (auto &pending : batch) {
+        pending.mutation(*next);
+        if (pending.published) {
+            published.push_back(std::move(pending.published));
+        }
+    }
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        more = !pending_.empty();
+    }
+    // with more writes queued the next batch relabels for both; readers take the fallbacks meanwhile
+    if (!more && !next->graph.labelsFresh()) {
+        next->graph.relabel();
+    }
+    next->epoch = epoch_.load(std::memory_order_relaxed) + 1;
+    auto epoch = next->epoch;
+    std::atomic_store_explicit(&current_, std::shared_ptr<const OrgSnapshot>(std::move(next)), std::memory_order_release);
+    epoch_.store(epoch, std::memory_order_release);
+    return published;
+}
+
+auto OrgGraphPlugin::toNode(const Person &person) -> OrgGraph::Node {
+    OrgGraph::Node node;
+    node.id = person.getValueOfId();
+    node.managerId = person.getValueOfManagerId();
+    node.departmentId = person.getValueOfDepartmentId();
+    node.jobId = person.getValueOfJobId();
+    node.firstName = person.getValueOfFirstName();
+    node.lastName = person.getValueOfLastName();
+    if (person.getHireDate()) {
+        node.hireDate = person.getHireDate()->toDbStringLocal();
+    }
+    return node;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <drogon/plugins/Plugin.h>
+#include <trantor/net/EventLoopThread.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "NameIndex.h"
+#include "OrgGraph.h"
+#include "../models/Department.h"
+#include "../models/Job.h"
+#include "../models/Person.h"
+
+/**
+ * One immutable version of the in-memory org. epoch grows by one with every
+ * published version. The department and job maps are shared between versions
+ * until a write replaces one, so a batch of person writes only copies the graph.
+ */
+struct OrgSnapshot {
+    using Departments = std::unordered_map<int32_t, drogon_model::org_chart::Department>;
+    using Jobs = std::unordered_map<int32_t, drogon_model::org_chart::Job>;
+
+    uint64_t epoch{0};
+    OrgGraph graph;
+    std::shared_ptr<const Departments> departments{std::make_shared<const Departments>()};
+    std::shared_ptr<const Jobs> jobs{std::make_shared<const Jobs>()};
+};
+
+/**
+ * Owns the process-wide OrgSnapshot. It is loaded from the database once the
+ * event loop is running and patched by the write handlers, so hierarchy reads
+ * never have to go to Postgres and person reads can take department names,
+ * job titles and manager names from memory instead of joining them. A failed
+ * initial load is retried; isReady() turns true once the first snapshot is
+ * published and every onReady() hook has run on it.
+ *
+ * Readers never lock: every thread keeps its own reference to the snapshot it
+ * last read and only swaps it when the published epoch moves. Writers only
+ * queue their mutation. A dedicated writer thread applies everything queued
+ * so far to one copy of the current snapshot and publishes it, so neither the
+ * copy nor the patching runs on an IO thread and a burst of writes costs one
+ * copy. The copy is relabeled before it is published unless more writes are
+ * already queued, in which case the next batch relabels for both and label
+ * queries take their fallbacks meanwhile. A write is visible to every reader
+ * once its published callback runs, on the writer thread; callers drop what
+ * they cached and answer from there.
+ *
+ * Person names are also kept in a NameIndex next to the snapshot, rather
+ * than in it, so a write does not copy the index; searches share a lock. The
+ * index is updated when a write is queued, so it runs ahead of the snapshot.
+ */
+class OrgGraphPlugin : public drogon::Plugin<OrgGraphPlugin> {
+ public:
+    using Mutation = std::function<void(OrgSnapshot &)>;
+    using Published = std::function<void()>;
+    using ReadyHook = std::function<void(const OrgSnapshot &)>;
+
+    virtual void initAndStart(const Json::Value &config) override;
+    virtual void shutdown() override;
+
+    auto isReady() const -> bool;
+    auto epoch() const -> uint64_t;
+    /// Loads everything again; reloaded runs once the fresh snapshot is published. Retried until it succeeds.
+    void reload(Published reloaded = {});
+    /// Runs hook on the first snapshot before the plugin reports ready, e.g. to warm caches; at once if already ready.
+    void onReady(ReadyHook hook);
+    void upsert(const drogon_model::org_chart::Person &person, Published published = {});
+    void erase(int32_t personId, Published published = {});
+    void applyMoves(const std::vector<OrgGraph::Move> &moves, Published published = {});
+    void upsertDepartment(const drogon_model::org_chart::Department &department, Published published = {});
+    void eraseDepartment(int32_t departmentId, Published published = {});
+    void upsertJob(const drogon_model::org_chart::Job &job, Published published = {});
+    void eraseJob(int32_t jobId, Published published = {});
+    /// Reloads departments and jobs in the background, e.g. after a lookup missed; concurrent calls share one load.
+    void refreshReferenceData();
+
+    /// Holds a version for longer than one read, e.g. across several queries that must agree.
+    auto snapshot() const -> std::shared_ptr<const OrgSnapshot>;
+
+    template <typename Reader>
+    decltype(auto) read(Reader &&reader) const {
+        Pin pin(*this);
+        return reader(pin->graph);
+    }
+
+    template <typename Reader>
+    decltype(auto) readSnapshot(Reader &&reader) const {
+        Pin pin(*this);
+        return reader(*pin);
+    }
+
+    /// Ids of up to limit persons whose names match query, best match first; see NameIndex.
+    auto searchNames(const std::string &query, size_t limit) const -> std::vector<int32_t>;
+
+    static auto toNode(const drogon_model::org_chart::Person &person) -> OrgGraph::Node;
+
+ private:
+    // Pins the calling thread's snapshot for the duration of a read. The thread's
+    // reference is only refreshed by the outermost read, so nested reads are safe.
+    class Pin {
+     public:
+        explicit Pin(const OrgGraphPlugin &plugin);
+        ~Pin();
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+
+        const OrgSnapshot &operator*() const { return *snapshot_; }
+        const OrgSnapshot *operator->() const { return snapshot_; }
+
+     private:
+        const OrgSnapshot *snapshot_;
+    };
+
+    struct Pending {
+        Mutation mutation;
+        Published published;
+    };
+
+    void runReadyHooks(const OrgSnapshot &snapshot);
+    void publish(Mutation mutation, Published published);
+    void flush();
+    auto publishLocked(std::shared_ptr<OrgSnapshot> next) -> std::vector<Published>;
+
+    // only touched through std::atomic_load / std::atomic_store
+    std::shared_ptr<const OrgSnapshot> current_{std::make_shared<const OrgSnapshot>()};
+    std::atomic<uint64_t> epoch_{0};
+    trantor::EventLoopThread writer_{"OrgGraphWriter"};
+    // held while a snapshot is built from the current one and stored
+    std::mutex writerMutex_;
+    std::mutex pendingMutex_;
+    std::vector<Pending> pending_;
+    bool flushQueued_{false};
+    mutable std::shared_mutex namesMutex_;
+    NameIndex names_;
+    std::mutex hooksMutex_;
+    std::vector<ReadyHook> readyHooks_;
+    double retrySeconds_{5};
+    std::atomic<bool> ready_{false};
+    std::atomic<bool> refreshing_{false};
+};
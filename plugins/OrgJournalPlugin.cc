@@ -0,0 +1,40 @@
+#include "OrgJournalPlugin.h"
+#include <drogon/drogon.h>
+
+using namespace drogon;
+
+void OrgJournalPlugin::initAndStart(const Json::Value &config) {
+    LOG_DEBUG << "OrgJournal initialized and Start";
+    dbClientName_ = config.get("db_client", "default").asString();
+    retentionDays_ = config.get("retention_days", 90).asInt();
+    if (retentionDays_ <= 0) {
+        LOG_INFO << "OrgJournal keeps every change";
+        return;
+    }
+    auto pruneEverySeconds = config.get("prune_every_seconds", 3600.0).asDouble();
+    pruneTimer_ = drogon::app().getLoop()->runEvery(pruneEverySeconds, [this]() { prune(); });
+}
+
+void OrgJournalPlugin::shutdown() {
+    if (pruneTimer_ != 0) {
+        drogon::app().getLoop()->invalidateTimer(pruneTimer_);
+    }
+    LOG_DEBUG << "OrgJournal shut down";
+}
+
+void OrgJournalPlugin::prune() {
+    auto dbClientPtr = drogon::app().getDbClient(dbClientName_);
+    if (!dbClientPtr) {
+        return;
+    }
+    dbClientPtr->execSqlAsync(
+        "select prune_org_journal(make_interval(days => $1)) as pruned",
+        [](const orm::Result &result) {
+            auto pruned = result[0]["pruned"].as<int64_t>();
+            if (pruned > 0) {
+                LOG_INFO << "OrgJournal pruned " << pruned << " changes";
+            }
+        },
+        [](const orm::DrogonDbException &e) { LOG_ERROR << "OrgJournal prune failed: " << e.base().what(); },
+        retentionDays_);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <drogon/plugins/Plugin.h>
+#include <trantor/net/EventLoop.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * Keeps org_journal from growing without bound: every prune_every_seconds
+ * it has prune_org_journal() (see scripts/create_db.sql) delete the rows
+ * older than retention_days. Every node runs this; the database lets one
+ * prune at a time and the others return at once. /org/diff answers 410 to
+ * a cursor or from timestamp that reaches back past what was pruned.
+ */
+class OrgJournalPlugin : public drogon::Plugin<OrgJournalPlugin> {
+ public:
+    virtual void initAndStart(const Json::Value &config) override;
+    virtual void shutdown() override;
+
+ private:
+    void prune();
+
+    std::string dbClientName_;
+    int32_t retentionDays_{0};
+    trantor::TimerId pruneTimer_{0};
+};
@@ -0,0 +1,41 @@
+#include "ResponseCachePlugin.h"
+#include <drogon/drogon.h>
+
+using namespace drogon;
+
+void ResponseCachePlugin::initAndStart(const Json::Value &config) {
+    LOG_DEBUG << "ResponseCache initialized and Start";
+    auto maxBytes = config.get("person_max_bytes", 64 * 1024 * 1024).asUInt64();
+    auto shards = config.get("shards", 16).asUInt();
+    persons_ = std::make_unique<BodyCache>(maxBytes, shards);
+
+    auto missingTtl = std::chrono::seconds(config.get("missing_ttl_seconds", 5).asUInt());
+    auto missingMax = config.get("missing_max_entries", 100000).asUInt64();
+    missingPersons_ = std::make_unique<NegativeCache>(missingTtl, missingMax);
+    missingDepartments_ = std::make_unique<NegativeCache>(missingTtl, missingMax);
+    missingJobs_ = std::make_unique<NegativeCache>(missingTtl, missingMax);
+}
+
+void ResponseCachePlugin::shutdown() {
+    LOG_DEBUG << "ResponseCache shut down";
+}
+
+auto ResponseCachePlugin::persons() -> BodyCache & {
+    return *persons_;
+}
+
+auto ResponseCachePlugin::missingPersons() -> NegativeCache & {
+    return *missingPersons_;
+}
+
+auto ResponseCachePlugin::missingDepartments() -> NegativeCache & {
+    return *missingDepartments_;
+}
+
+auto ResponseCachePlugin::missingJobs() -> NegativeCache & {
+    return *missingJobs_;
+}
+
+auto ResponseCachePlugin::reads() -> SingleFlight<drogon::orm::Result, drogon::orm::DrogonDbException> & {
+    return reads_;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <drogon/plugins/Plugin.h>
+#include <drogon/orm/Result.h>
+#include <drogon/orm/Exception.h>
+#include <memory>
+#include "BodyCache.h"
+#include "NegativeCache.h"
+#include "SingleFlight.h"
+
+/**
+ * Owns the serialized response caches, the ids known to be missing and the
+ * table of reads in flight. Handlers that change what a cached body embeds
+ * are responsible for invalidating it, creates erase the new id from the
+ * missing ids, and every person write makes in-flight reads forget. Reads
+ * are forgotten before bodies are erased: a reader that takes its ticket
+ * after the erase must not join a query that started before the write, or it
+ * would store the old row under a valid ticket. Writes made through other
+ * nodes are applied the same way by ChangeListenerPlugin.
+ */
+class ResponseCachePlugin : public drogon::Plugin<ResponseCachePlugin> {
+ public:
+    virtual void initAndStart(const Json::Value &config) override;
+    virtual void shutdown() override;
+
+    /// GET /persons/{id} bodies keyed by person id.
+    auto persons() -> BodyCache &;
+    /// Ids recently found missing, per table.
+    auto missingPersons() -> NegativeCache &;
+    auto missingDepartments() -> NegativeCache &;
+    auto missingJobs() -> NegativeCache &;
+    /// Person reads keyed by SQL and parameters.
+    auto reads() -> SingleFlight<drogon::orm::Result, drogon::orm::DrogonDbException> &;
+
+ private:
+    std::unique_ptr<BodyCache> persons_;
+    std::unique_ptr<NegativeCache> missingPersons_;
+    std::unique_ptr<NegativeCache> missingDepartments_;
+    std::unique_ptr<NegativeCache> missingJobs_;
+    SingleFlight<drogon::orm::Result, drogon::orm::DrogonDbException> reads_;
+};
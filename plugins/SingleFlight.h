@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Coalesces identical concurrent reads. The first caller for a key starts the
+ * call; callers arriving while it runs are queued behind it and every one of
+ * them gets the same outcome, so a burst of equal requests costs one query.
+ *
+ * forget() detaches the calls in flight after a write: their waiters still get
+ * the result they were waiting for, but later callers start a fresh call that
+ * is guaranteed to see the write.
+ */
+template <typename Result, typename Error>
+class SingleFlight {
+ public:
+    using ResultCallback = std::function<void(const Result &)>;
+    using ErrorCallback = std::function<void(const Error &)>;
+
+    /// start(onResult, onError) is invoked without the lock held, only by the caller that leads.
+    template <typename Start>
+    void run(const std::string &key, ResultCallback onResult, ErrorCallback onError, Start &&start) {
+        std::shared_ptr<Call> call;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &slot = calls_[key];
+            if (slot) {
+                slot->waiters.emplace_back(std::move(onResult), std::move(onError));
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            slot = std::make_shared<Call>();
+            slot->waiters.emplace_back(std::move(onResult), std::move(onError));
+            call = slot;
+        }
+        start([this, key, call](const Result &result) {
+                  for (auto &waiter : finish(key, call)) {
+                      waiter.first(result);
+                  }
+              },
+              [this, key, call](const Error &error) {
+                  for (auto &waiter : finish(key, call)) {
+                      waiter.second(error);
+                  }
+              });
+    }
+
+    void forget() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.clear();
+    }
+
+    auto inFlight() const -> size_t {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_.size();
+    }
+
+    /// Callers that were served by somebody else's call.
+    auto coalesced() const -> uint64_t {
+        return coalesced_.load(std::memory_order_relaxed);
+    }
+
+ private:
+    struct Call {
+        std::vector<std::pair<ResultCallback, ErrorCallback>> waiters;
+    };
+
+    auto finish(const std::string &key, const std::shared_ptr<Call> &call) -> std::vector<std::pair<ResultCallback, ErrorCallback>> {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = calls_.find(key);
+        // after forget() the key may already belong to a newer call
+        if (it != calls_.end() && it->second == call) {
+            calls_.erase(it);
+        }
+        return std::move(call->waiters);
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Call>> calls_;
+    std::atomic<uint64_t> coalesced_{0};
+};
@@ -27,3 +27,131 @@ CREATE TABLE users (
     username VARCHAR(50) UNIQUE NOT NULL,
     password VARCHAR UNIQUE NOT NULL
 );
+
+-- one narrow row per write; person rows carry the manager/department before and after the change.
+-- id and changed_at are taken before the writing transaction commits, so they are not commit order;
+-- xid is what /org/diff pages by (see there)
+CREATE TABLE org_journal (
+    id BIGSERIAL PRIMARY KEY,
+    changed_at TIMESTAMPTZ NOT NULL DEFAULT now(),
+    xid xid8 NOT NULL DEFAULT pg_current_xact_id(),
+    entity VARCHAR(16) NOT NULL,
+    entity_id int NOT NULL,
+    kind VARCHAR(16) NOT NULL,
+    old_manager_id int,
+    manager_id int,
+    old_department_id int,
+    department_id int
+);
+
+CREATE INDEX org_journal_changed_at ON org_journal (changed_at);
+CREATE INDEX org_journal_xid ON org_journal (xid);
+
+-- how far prune_org_journal() has deleted, so /org/diff can tell a client its cursor fell behind
+CREATE TABLE org_journal_horizon (
+    only_row boolean PRIMARY KEY DEFAULT true CHECK (only_row),
+    pruned_xid xid8 NOT NULL DEFAULT '0',
+    pruned_before TIMESTAMPTZ NOT NULL DEFAULT '-infinity'
+);
+
+INSERT INTO org_journal_horizon DEFAULT VALUES;
+
+-- deletes what is older than keep; every node calls this now and then, so one at a time is plenty
+CREATE FUNCTION prune_org_journal(keep interval) RETURNS bigint AS $$
+DECLARE
+    cutoff TIMESTAMPTZ := now() - keep;
+    pruned bigint;
+    newest xid8;
+BEGIN
+    IF NOT pg_try_advisory_xact_lock(hashtext('prune_org_journal')) THEN
+        RETURN 0;
+    END IF;
+    WITH gone AS (
+        DELETE FROM org_journal WHERE changed_at < cutoff RETURNING xid
+    )
+    SELECT count(*), (SELECT xid FROM gone ORDER BY xid DESC LIMIT 1) INTO pruned, newest FROM gone;
+    UPDATE org_journal_horizon
+       SET pruned_xid = CASE WHEN newest IS NULL OR newest < pruned_xid THEN pruned_xid ELSE newest END,
+           pruned_before = greatest(pruned_before, cutoff);
+    RETURN pruned;
+END;
+$$ LANGUAGE plpgsql;
+
+-- written by the statement that makes the change, inside its transaction, so no write goes
+-- unjournaled and the before/after ids are exactly what the row held
+CREATE FUNCTION journal_org_change() RETURNS trigger AS $$
+BEGIN
+    IF TG_TABLE_NAME <> 'person' THEN
+        IF TG_OP = 'DELETE' THEN
+            INSERT INTO org_journal (entity, entity_id, kind) VALUES (TG_TABLE_NAME, OLD.id, 'delete');
+        ELSIF TG_OP = 'UPDATE' THEN
+            INSERT INTO org_journal (entity, entity_id, kind) VALUES (TG_TABLE_NAME, NEW.id, 'update');
+        ELSE
+            INSERT INTO org_journal (entity, entity_id, kind) VALUES (TG_TABLE_NAME, NEW.id, 'create');
+        END IF;
+    ELSIF TG_OP = 'DELETE' THEN
+        INSERT INTO org_journal (entity, entity_id, kind, old_manager_id, old_department_id)
+            VALUES ('person', OLD.id, 'delete', OLD.manager_id, OLD.department_id);
+    ELSIF TG_OP = 'UPDATE' THEN
+        INSERT INTO org_journal (entity, entity_id, kind, old_manager_id, manager_id, old_department_id, department_id)
+            VALUES ('person', NEW.id, 'update', OLD.manager_id, NEW.manager_id, OLD.department_id, NEW.department_id);
+    ELSE
+        INSERT INTO org_journal (entity, entity_id, kind, manager_id, department_id)
+            VALUES ('person', NEW.id, 'create', NEW.manager_id, NEW.department_id);
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER person_journal AFTER INSERT OR UPDATE OR DELETE ON person
+    FOR EACH ROW EXECUTE FUNCTION journal_org_change();
+CREATE TRIGGER department_journal AFTER INSERT OR UPDATE OR DELETE ON department
+    FOR EACH ROW EXECUTE FUNCTION journal_org_change();
+CREATE TRIGGER job_journal AFTER INSERT OR UPDATE OR DELETE ON job
+    FOR EACH ROW EXECUTE FUNCTION journal_org_change();
+
+-- the API checks manager changes against its snapshot, which races with concurrent writes; this
+-- has the last word. It runs at commit, so a reorg may pass through a loop between statements,
+-- and the lock makes committing transactions that change managers see each other's changes.
+CREATE FUNCTION check_reporting_loop() RETURNS trigger AS $$
+BEGIN
+    PERFORM pg_advisory_xact_lock(hashtext('person_no_loop'));
+    IF EXISTS (
+        WITH RECURSIVE chain(id) AS (
+            SELECT manager_id FROM person WHERE id = NEW.id AND manager_id <> id
+            UNION
+            SELECT person.manager_id FROM person JOIN chain ON person.id = chain.id
+                WHERE person.manager_id <> person.id
+        )
+        SELECT 1 FROM chain WHERE id = NEW.id
+    ) THEN
+        RAISE EXCEPTION 'person % would be in a reporting loop', NEW.id USING ERRCODE = 'check_violation';
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE CONSTRAINT TRIGGER person_no_loop AFTER UPDATE OF manager_id ON person
+    DEFERRABLE INITIALLY DEFERRED
+    FOR EACH ROW WHEN (OLD.manager_id IS DISTINCT FROM NEW.manager_id)
+    EXECUTE FUNCTION check_reporting_loop();
+
+-- every API node LISTENs on org_changes and drops only what it cached for the changed row;
+-- the row rides along (well under the 8000 byte payload limit) so nodes need not read it back
+CREATE FUNCTION notify_org_change() RETURNS trigger AS $$
+BEGIN
+    IF TG_OP = 'DELETE' THEN
+        PERFORM pg_notify('org_changes', json_build_object('table', TG_TABLE_NAME, 'op', TG_OP, 'id', OLD.id, 'row', NULL)::text);
+    ELSE
+        PERFORM pg_notify('org_changes', json_build_object('table', TG_TABLE_NAME, 'op', TG_OP, 'id', NEW.id, 'row', row_to_json(NEW))::text);
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE TRIGGER person_notify AFTER INSERT OR UPDATE OR DELETE ON person
+    FOR EACH ROW EXECUTE FUNCTION notify_org_change();
+CREATE TRIGGER department_notify AFTER INSERT OR UPDATE OR DELETE ON department
+    FOR EACH ROW EXECUTE FUNCTION notify_org_change();
+CREATE TRIGGER job_notify AFTER INSERT OR UPDATE OR DELETE ON job
+    FOR EACH ROW EXECUTE FUNCTION notify_org_change();
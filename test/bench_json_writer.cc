@@ -0,0 +1,169 @@
+// Compares writing a page of persons through a Json::Value tree, the way the controllers
+// did, with writing it straight into the body with JsonWriter. Not a test; run it by hand:
+//   ./bench_json_writer [rows per page] [pages]
+#include "../utils/JsonWriter.h"
+#include <json/json.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+// stands in for a joined person row; the fields are read as text like Field::as<> does
+struct Row {
+    std::string id;
+    std::string firstName;
+    std::string lastName;
+    std::string hireDate;
+    std::string managerId;
+    std::string managerFullName;
+    std::string departmentId;
+    std::string departmentName;
+    std::string jobId;
+    std::string jobTitle;
+};
+
+std::vector<Row> makeRows(size_t count) {
+    const char *firstNames[] = {"Ann", "Bob", "Chloé", "Dmitri", "Eve"};
+    const char *lastNames[] = {"Smith", "O'Brien", "Nguyen", "Müller", "Kowalski"};
+    std::vector<Row> rows;
+    for (size_t i = 0; i < count; ++i) {
+        Row row;
+        row.id = std::to_string(i + 2);
+        row.firstName = firstNames[i % 5];
+        row.lastName = lastNames[i / 5 % 5];
+        row.hireDate = "20" + std::to_string(10 + i % 15) + "-0" + std::to_string(1 + i % 9) + "-1" + std::to_string(i % 10);
+        row.managerId = std::to_string(i / 10 + 1);
+        row.managerFullName = std::string(firstNames[i / 10 % 5]) + " " + lastNames[i / 50 % 5];
+        row.departmentId = std::to_string(i % 12 + 1);
+        row.departmentName = "Department \"" + std::to_string(i % 12 + 1) + "\"";
+        row.jobId = std::to_string(i % 30 + 1);
+        row.jobTitle = "Senior Engineer " + std::to_string(i % 30 + 1);
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+// personDetailsJson() and serialize() as they were
+std::string treeBody(const std::vector<Row> &rows) {
+    static const Json::StreamWriterBuilder writer = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    Json::Value ret{};
+    for (const auto &row : rows) {
+        Json::Value person{};
+        person["id"] = std::stoi(row.id);
+        person["first_name"] = std::string(row.firstName);
+        person["last_name"] = std::string(row.lastName);
+        person["hire_date"] = std::string(row.hireDate);
+        Json::Value manager{};
+        manager["id"] = std::stoi(row.managerId);
+        manager["full_name"] = std::string(row.managerFullName);
+        person["manager"] = manager;
+        Json::Value department{};
+        department["id"] = std::stoi(row.departmentId);
+        department["name"] = std::string(row.departmentName);
+        person["department"] = department;
+        Json::Value job{};
+        job["id"] = std::stoi(row.jobId);
+        job["title"] = std::string(row.jobTitle);
+        person["job"] = job;
+        ret.append(person);
+    }
+    return Json::writeString(writer, ret);
+}
+
+// personDetailsBody()
+std::string writtenBody(const std::vector<Row> &rows) {
+    std::string body;
+    JsonWriter writer{body};
+    writer.beginArray();
+    size_t written = 0;
+    for (const auto &row : rows) {
+        writer.beginObject();
+        writer.key("department");
+        writer.beginObject();
+        writer.member("id", static_cast<int32_t>(std::atoi(row.departmentId.c_str())));
+        writer.member("name", std::string_view(row.departmentName));
+        writer.endObject();
+        writer.member("first_name", std::string_view(row.firstName));
+        writer.member("hire_date", std::string_view(row.hireDate));
+        writer.member("id", static_cast<int32_t>(std::atoi(row.id.c_str())));
+        writer.key("job");
+        writer.beginObject();
+        writer.member("id", static_cast<int32_t>(std::atoi(row.jobId.c_str())));
+        writer.member("title", std::string_view(row.jobTitle));
+        writer.endObject();
+        writer.member("last_name", std::string_view(row.lastName));
+        writer.key("manager");
+        writer.beginObject();
+        writer.member("full_name", std::string_view(row.managerFullName));
+        writer.member("id", static_cast<int32_t>(std::atoi(row.managerId.c_str())));
+        writer.endObject();
+        writer.endObject();
+        if (++written == 1) {
+            body.reserve(body.size() * rows.size() * 5 / 4);
+        }
+    }
+    writer.endArray();
+    return body;
+}
+
+template <typename Write>
+void measure(const char *name, Write &&write, const std::vector<Row> &rows, size_t pages) {
+    std::vector<double> micros;
+    uint64_t allocated = 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < pages; ++i) {
+        auto before = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        auto body = write(rows);
+        micros.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        allocated += allocations.load(std::memory_order_relaxed) - before;
+        bytes = body.size();
+    }
+    std::sort(micros.begin(), micros.end());
+    std::printf("%-8s %8zu bytes %10.1f allocs/page   p50 %8.1f us   p99 %8.1f us\n", name, bytes,
+                static_cast<double>(allocated) / pages, micros[pages / 2], micros[pages * 99 / 100]);
+}
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char *argv[]) {
+    size_t rowCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    size_t pages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    auto rows = makeRows(rowCount);
+    if (treeBody(rows) != writtenBody(rows)) {
+        std::fprintf(stderr, "bodies differ\n");
+        return 1;
+    }
+    std::printf("%zu rows per page, %zu pages\n", rowCount, pages);
+    measure("tree", treeBody, rows, pages);
+    measure("writer", writtenBody, rows, pages);
+    return 0;
+}
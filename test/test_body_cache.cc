@@ -0,0 +1,94 @@
+#include <drogon/drogon_test.h>
+#include "../plugins/BodyCache.h"
+#include "../plugins/SingleFlight.h"
+
+namespace {
+
+BodyCache::Body makeBody(size_t size, char fill = 'x') {
+    return std::make_shared<const BodyCache::Entry>(BodyCache::Entry{std::string(size, fill), ""});
+}
+
+}  // namespace
+
+DROGON_TEST(BodyCacheLruTest)
+{
+    // one shard of 30 bytes
+    BodyCache cache(30, 1);
+    cache.put(1, makeBody(10), cache.ticket(1));
+    cache.put(2, makeBody(10), cache.ticket(2));
+    cache.put(3, makeBody(10), cache.ticket(3));
+    REQUIRE(cache.get(1) != nullptr);
+
+    // 2 is now the least recently used
+    cache.put(4, makeBody(10), cache.ticket(4));
+    CHECK(cache.get(2) == nullptr);
+    CHECK(cache.get(1) != nullptr);
+    CHECK(cache.get(4) != nullptr);
+
+    auto stats = cache.stats();
+    CHECK(stats.entries == 3);
+    CHECK(stats.bytes == 30);
+    CHECK(stats.evictions == 1);
+    CHECK(stats.hits == 3);
+    CHECK(stats.misses == 1);
+
+    // too big to ever fit
+    cache.put(5, makeBody(31), cache.ticket(5));
+    CHECK(cache.get(5) == nullptr);
+
+    // replacing a body keeps the byte count exact
+    cache.put(1, makeBody(5), cache.ticket(1));
+    CHECK(cache.stats().bytes == 25);
+}
+
+DROGON_TEST(BodyCacheInvalidationTest)
+{
+    BodyCache cache(1024, 4);
+    cache.put(1, makeBody(10), cache.ticket(1));
+    cache.erase(1);
+    CHECK(cache.get(1) == nullptr);
+
+    // a body read before an invalidation is not stored
+    auto ticket = cache.ticket(2);
+    cache.erase(2);
+    cache.put(2, makeBody(10), ticket);
+    CHECK(cache.get(2) == nullptr);
+
+    ticket = cache.ticket(3);
+    cache.clear();
+    cache.put(3, makeBody(10), ticket);
+    CHECK(cache.get(3) == nullptr);
+    cache.put(3, makeBody(10), cache.ticket(3));
+    CHECK(cache.get(3) != nullptr);
+    CHECK(cache.stats().entries == 1);
+}
+
+DROGON_TEST(BodyCacheReadDuringWriteTest)
+{
+    // the read path of GET /persons/{id}: take a ticket, join or start the load, store with the ticket
+    BodyCache cache(1024, 1);
+    SingleFlight<std::string, std::string> reads;
+    std::vector<std::function<void(const std::string &)>> loads;
+    auto read = [&cache, &reads, &loads]() {
+        auto ticket = cache.ticket(1);
+        reads.run("1",
+                  [&cache, ticket](const std::string &row) { cache.put(1, makeBody(row.size(), row[0]), ticket); },
+                  [](const std::string &) {},
+                  [&loads](auto onResult, auto) { loads.push_back(onResult); });
+    };
+
+    read();  // loads the row as it was before the write
+    // the write commits; invalidation forgets reads in flight, then erases
+    reads.forget();
+    read();  // between the two: starts a load that sees the write
+    cache.erase(1);
+    read();  // after both: must join the new load, not the old one
+    REQUIRE(loads.size() == 2);
+
+    loads[0]("o");
+    CHECK(cache.get(1) == nullptr);
+    loads[1]("nn");
+    auto body = cache.get(1);
+    REQUIRE(body != nullptr);
+    CHECK(body->body == "nn");
+}
@@ -0,0 +1,72 @@
+#include <drogon/drogon_test.h>
+#include "../utils/FilterExpr.h"
+
+namespace {
+
+const std::vector<FilterExpr::Column> kColumns{{"id", FilterExpr::Type::kInteger},
+                                               {"manager_id", FilterExpr::Type::kInteger},
+                                               {"department_id", FilterExpr::Type::kInteger},
+                                               {"hire_date", FilterExpr::Type::kDate},
+                                               {"last_name", FilterExpr::Type::kText}};
+
+FilterExpr::Sql render(const std::string &text) {
+    std::string error;
+    auto filter = FilterExpr::parse(text, kColumns, error);
+    return filter ? filter->render("person", 1) : FilterExpr::Sql{"error: " + error, {}};
+}
+
+std::string error(const std::string &text) {
+    std::string error;
+    auto filter = FilterExpr::parse(text, kColumns, error);
+    return filter ? "" : error;
+}
+
+}  // namespace
+
+DROGON_TEST(FilterExprRenderTest)
+{
+    auto sql = render("department_id eq 3 and (hire_date ge 2020-01-01 or manager_id in (1, 2))");
+    CHECK(sql.condition == "(person.department_id = $1::int and (person.hire_date >= $2::date or person.manager_id = any($3::int[])))");
+    CHECK((sql.params == std::vector<std::string>{"3", "2020-01-01", "{\"1\",\"2\"}"}));
+
+    // the same shape renders the same text whatever the values and operand order
+    auto swapped = render("(manager_id in (7, 8, 9) or hire_date ge 1999-12-31) and department_id eq 4");
+    CHECK(swapped.condition == sql.condition);
+    CHECK((swapped.params == std::vector<std::string>{"4", "1999-12-31", "{\"7\",\"8\",\"9\"}"}));
+
+    // chains flatten, and binds tighter than or
+    CHECK(render("id eq 1 or id eq 2 or (id eq 3 or id eq 4)").condition ==
+          "(person.id = $1::int or person.id = $2::int or person.id = $3::int or person.id = $4::int)");
+    CHECK(render("id eq 3 or id eq 1 and id eq 2").condition == "((person.id = $1::int and person.id = $2::int) or person.id = $3::int)");
+    CHECK((render("id eq 3 or id eq 1 and id eq 2").params == std::vector<std::string>{"1", "2", "3"}));
+
+    auto text = render("LAST_NAME eq 'O''Brien' and last_name in ('a\"b')");
+    CHECK(text.condition == "(person.last_name = $1::text and person.last_name = any($2::text[]))");
+    CHECK((text.params == std::vector<std::string>{"O'Brien", "{\"a\\\"b\"}"}));
+
+    CHECK(render("id gt 5").condition == "person.id > $1::int");
+    CHECK(render("id gt 5").condition.find('5') == std::string::npos);
+}
+
+DROGON_TEST(FilterExprErrorTest)
+{
+    CHECK(error("salary eq 5") == "unknown column 'salary'");
+    CHECK(error("id eq 'x'") == "'id' takes an integer");
+    CHECK(error("id eq 99999999999") == "'id' takes an integer");
+    CHECK(error("hire_date lt 2021-02-29") == "'hire_date' takes a date (YYYY-MM-DD)");
+    CHECK(error("hire_date lt 2020-02-29").empty());
+    CHECK(error("last_name eq smith") == "'last_name' takes a quoted string");
+    CHECK(error("id like 5") == "expected eq, ne, lt, le, gt, ge or in after 'id'");
+    CHECK(error("id in (1, 2") == "missing ')' after the values of 'id'");
+    CHECK(error("last_name eq 'open") == "unterminated string");
+    CHECK(error("id eq 1 and") == "expected a column");
+    CHECK(error("id eq 1; drop table person") == "unexpected ';'");
+    CHECK(error("id eq 1 id eq 2") == "unexpected 'id'");
+    CHECK(error("((((((((((id eq 1))))))))))") == "nested more than 8 levels deep");
+
+    std::string many = "id eq 1";
+    for (int i = 0; i < 16; ++i) {
+        many += " or id eq 1";
+    }
+    CHECK(error(many) == "more than 16 comparisons");
+}
@@ -0,0 +1,100 @@
+#include <drogon/drogon_test.h>
+#include "../utils/JsonWriter.h"
+#include <json/json.h>
+
+namespace {
+
+// what the controllers' serialize() and newHttpJsonResponse write
+std::string jsoncpp(const Json::Value &json) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    builder["emitUTF8"] = true;
+    return Json::writeString(builder, json);
+}
+
+std::string written(std::string_view text) {
+    std::string out;
+    JsonWriter writer{out};
+    writer.value(text);
+    return out;
+}
+
+}  // namespace
+
+DROGON_TEST(JsonWriterStructureTest)
+{
+    // keys written in jsoncpp's sorted order give the same text
+    std::string out;
+    JsonWriter writer{out};
+    writer.beginArray();
+    for (int32_t id : {1, -2}) {
+        writer.beginObject();
+        writer.member("active", id > 0);
+        writer.member("big", int64_t{1} << 40);
+        writer.key("department");
+        writer.beginObject();
+        writer.member("id", id);
+        writer.key("name");
+        writer.null();
+        writer.endObject();
+        writer.member("first_name", "Ann");
+        writer.key("tags");
+        writer.beginArray();
+        writer.endArray();
+        writer.endObject();
+    }
+    writer.beginObject();
+    writer.endObject();
+    writer.endArray();
+
+    Json::Value expected(Json::arrayValue);
+    for (int32_t id : {1, -2}) {
+        Json::Value person;
+        person["first_name"] = "Ann";
+        person["department"]["name"] = Json::Value();
+        person["department"]["id"] = id;
+        person["big"] = Json::Int64{1} << 40;
+        person["active"] = id > 0;
+        person["tags"] = Json::Value(Json::arrayValue);
+        expected.append(person);
+    }
+    expected.append(Json::Value(Json::objectValue));
+    CHECK(out == jsoncpp(expected));
+}
+
+DROGON_TEST(JsonWriterEscapeTest)
+{
+    const std::vector<std::string> texts{"plain",
+                                         "quote \" and backslash \\ and slash /",
+                                         "\b\f\n\r\t\x01\x1f\x7f",
+                                         std::string("nul\0byte", 8),
+                                         "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80",
+                                         // malformed input is copied as is, like jsoncpp does
+                                         "cut \xc3",
+                                         "\xff stray",
+                                         "\xc3( unchecked",
+                                         "\xed\xa0\x80 surrogate",
+                                         "\xc0\xaf overlong"};
+    for (const auto &text : texts) {
+        CHECK(written(text) == jsoncpp(Json::Value(text)));
+    }
+    CHECK(written("\x01") == "\"\\u0001\"");
+}
+
+DROGON_TEST(JsonWriterNonAsciiTest)
+{
+    // names outside ASCII go out as raw UTF-8, not \u escapes, as newHttpJsonResponse writes them
+    CHECK(written("Jos\xc3\xa9 M\xc3\xbcller") == "\"Jos\xc3\xa9 M\xc3\xbcller\"");
+    CHECK(written("\xe2\x82\xac") == "\"\xe2\x82\xac\"");
+    CHECK(written("\xf0\x9f\x98\x80") == "\"\xf0\x9f\x98\x80\"");
+    Json::Value person;
+    person["first_name"] = "Zo\xc3\xab";
+    person["last_name"] = "\xe7\x8e\x8b";
+    std::string out;
+    JsonWriter writer{out};
+    writer.beginObject();
+    writer.member("first_name", "Zo\xc3\xab");
+    writer.member("last_name", "\xe7\x8e\x8b");
+    writer.endObject();
+    CHECK(out == jsoncpp(person));
+}
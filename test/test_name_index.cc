@@ -0,0 +1,52 @@
+#include <drogon/drogon_test.h>
+#include "../plugins/NameIndex.h"
+
+namespace {
+
+OrgGraph::Node makeNode(int32_t id, const std::string &firstName, const std::string &lastName) {
+    OrgGraph::Node node;
+    node.id = id;
+    node.managerId = 1;
+    node.firstName = firstName;
+    node.lastName = lastName;
+    return node;
+}
+
+}  // namespace
+
+DROGON_TEST(NameIndexSearchTest)
+{
+    NameIndex index({makeNode(4, "Johanna", "Smith"), makeNode(1, "John", "Smith"), makeNode(2, "Jane", "Johnson"),
+                     makeNode(3, "Mary", "St. John")});
+    CHECK(index.size() == 4);
+
+    // whole word, then prefix, then inside a word
+    CHECK((index.search("john", 10) == std::vector<int32_t>{1, 3, 2}));
+    CHECK((index.search("ohn", 10) == std::vector<int32_t>{1, 3, 2}));
+    // short words only match word starts
+    CHECK((index.search("jo", 10) == std::vector<int32_t>{1, 3, 2, 4}));
+    CHECK(index.search("oh", 10).empty());
+
+    CHECK((index.search("  SMITH, jo ", 10) == std::vector<int32_t>{1, 4}));
+    CHECK((index.search("john", 1) == std::vector<int32_t>{1}));
+    CHECK(index.search("john smith mary", 10).empty());
+    CHECK(index.search("xyz", 10).empty());
+    CHECK(index.search("", 10).empty());
+}
+
+DROGON_TEST(NameIndexWriteTest)
+{
+    NameIndex index;
+    index.upsert(1, "Ann", "Lee");
+    index.upsert(2, "Anna", "Leeds");
+    CHECK((index.search("lee", 10) == std::vector<int32_t>{1, 2}));
+
+    index.upsert(1, "Ann", "Kim");
+    CHECK((index.search("lee", 10) == std::vector<int32_t>{2}));
+    CHECK((index.search("kim", 10) == std::vector<int32_t>{1}));
+
+    index.erase(2);
+    CHECK(index.search("leeds", 10).empty());
+    CHECK((index.search("an", 10) == std::vector<int32_t>{1}));
+    CHECK(index.size() == 1);
+}
@@ -0,0 +1,58 @@
+#include <drogon/drogon_test.h>
+#include "../plugins/NegativeCache.h"
+
+using namespace std::chrono_literals;
+
+DROGON_TEST(NegativeCacheTtlTest)
+{
+    NegativeCache cache(5s, 10);
+    auto now = NegativeCache::Clock::now();
+    cache.add(1, cache.ticket(), now);
+    CHECK(cache.contains(1, now + 4s));
+    CHECK(!cache.contains(1, now + 5s));
+    CHECK(!cache.contains(2, now));
+    CHECK(cache.hits() == 1);
+
+    // creating the id forgets it at once
+    cache.add(3, cache.ticket(), now);
+    cache.erase(3);
+    CHECK(!cache.contains(3, now));
+
+    // a miss read before a create is not remembered after it
+    auto ticket = cache.ticket();
+    cache.erase(4);
+    cache.add(4, ticket, now);
+    CHECK(!cache.contains(4, now));
+
+    // clearing forgets everything, including misses read before it
+    ticket = cache.ticket();
+    cache.add(5, cache.ticket(), now);
+    cache.clear();
+    cache.add(6, ticket, now);
+    CHECK(!cache.contains(5, now));
+    CHECK(!cache.contains(6, now));
+    CHECK(cache.size() == 0);
+}
+
+DROGON_TEST(NegativeCacheBoundTest)
+{
+    NegativeCache cache(5s, 3);
+    auto now = NegativeCache::Clock::now();
+    for (int32_t id = 1; id <= 5; ++id) {
+        cache.add(id, cache.ticket(), now + std::chrono::seconds(id));
+    }
+    CHECK(cache.size() == 3);
+    CHECK(!cache.contains(1, now + 5s));
+    CHECK(!cache.contains(2, now + 5s));
+    CHECK(cache.contains(5, now + 5s));
+
+    // expired entries make room before live ones are dropped
+    cache.add(6, cache.ticket(), now + 9s);
+    CHECK(cache.contains(5, now + 9s));
+    CHECK(cache.contains(6, now + 9s));
+    CHECK(cache.size() == 2);
+
+    // re-adding refreshes the expiry
+    cache.add(6, cache.ticket(), now + 12s);
+    CHECK(cache.contains(6, now + 16s));
+}
@@ -0,0 +1,75 @@
+#include <drogon/drogon_test.h>
+#include "../utils/OrgDiff.h"
+
+namespace {
+
+OrgDiff::Entry personEntry(int32_t id, const std::string &kind, std::optional<int32_t> oldManagerId, std::optional<int32_t> managerId) {
+    OrgDiff::Entry entry;
+    entry.entity = "person";
+    entry.entityId = id;
+    entry.kind = kind;
+    entry.oldManagerId = oldManagerId;
+    entry.managerId = managerId;
+    entry.oldDepartmentId = oldManagerId ? std::optional<int32_t>(1) : std::nullopt;
+    entry.departmentId = managerId ? std::optional<int32_t>(1) : std::nullopt;
+    return entry;
+}
+
+OrgDiff::Entry entityEntry(const std::string &entity, int32_t id, const std::string &kind) {
+    OrgDiff::Entry entry;
+    entry.entity = entity;
+    entry.entityId = id;
+    entry.kind = kind;
+    return entry;
+}
+
+}  // namespace
+
+DROGON_TEST(OrgDiffPersonTest)
+{
+    OrgDiff diff;
+    diff.add(personEntry(10, "create", std::nullopt, 1));
+    diff.add(personEntry(11, "update", 2, 3));
+    diff.add(personEntry(11, "update", 3, 4));
+    diff.add(personEntry(12, "delete", 2, std::nullopt));
+    // moved away and back again
+    diff.add(personEntry(13, "update", 2, 3));
+    diff.add(personEntry(13, "update", 3, 2));
+    // hired and let go inside the window
+    diff.add(personEntry(14, "create", std::nullopt, 1));
+    diff.add(personEntry(14, "delete", 1, std::nullopt));
+    diff.add(personEntry(10, "update", 1, 5));
+
+    auto json = diff.toJson();
+    REQUIRE(json["hires"].size() == 1);
+    CHECK(json["hires"][0]["id"].asInt() == 10);
+    CHECK(json["hires"][0]["manager_id"].asInt() == 5);
+    REQUIRE(json["departures"].size() == 1);
+    CHECK(json["departures"][0]["id"].asInt() == 12);
+    CHECK(json["departures"][0]["manager_id"].asInt() == 2);
+    REQUIRE(json["moves"].size() == 1);
+    CHECK(json["moves"][0]["id"].asInt() == 11);
+    CHECK(json["moves"][0]["from_manager_id"].asInt() == 2);
+    CHECK(json["moves"][0]["to_manager_id"].asInt() == 4);
+}
+
+DROGON_TEST(OrgDiffEntityTest)
+{
+    OrgDiff diff;
+    diff.add(entityEntry("department", 1, "update"));
+    diff.add(entityEntry("department", 2, "create"));
+    diff.add(entityEntry("department", 3, "delete"));
+    diff.add(entityEntry("job", 1, "create"));
+    diff.add(entityEntry("job", 1, "delete"));
+    diff.add(entityEntry("job", 2, "update"));
+    diff.add(entityEntry("job", 2, "delete"));
+
+    auto json = diff.toJson();
+    CHECK(json["departments"]["updated"].size() == 1);
+    CHECK(json["departments"]["created"][0].asInt() == 2);
+    CHECK(json["departments"]["deleted"][0].asInt() == 3);
+    CHECK(json["jobs"]["created"].empty());
+    CHECK(json["jobs"]["updated"].empty());
+    CHECK(json["jobs"]["deleted"][0].asInt() == 2);
+    CHECK(json["hires"].empty());
+}
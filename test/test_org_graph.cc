@@ -0,0 +1,330 @@
+#include <drogon/drogon_test.h>
+#include "../plugins/OrgGraph.h"
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace {
+
+OrgGraph::Node makeNode(int32_t id, int32_t managerId) {
+    OrgGraph::Node node;
+    node.id = id;
+    node.managerId = managerId;
+    node.departmentId = 1;
+    node.jobId = 1;
+    node.firstName = "first" + std::to_string(id);
+    node.lastName = "last" + std::to_string(id);
+    return node;
+}
+
+std::vector<int32_t> reportIds(const OrgGraph &graph, int32_t id) {
+    std::vector<int32_t> ids;
+    for (const auto *node : graph.directReports(id)) {
+        ids.push_back(node->id);
+    }
+    return ids;
+}
+
+}  // namespace
+
+DROGON_TEST(OrgGraphBuildTest)
+{
+    OrgGraph graph({makeNode(3, 1), makeNode(1, 1), makeNode(2, 1), makeNode(4, 2)});
+
+    CHECK(graph.size() == 4);
+    CHECK((reportIds(graph, 1) == std::vector<int32_t>{2, 3}));
+    CHECK((reportIds(graph, 2) == std::vector<int32_t>{4}));
+    CHECK(reportIds(graph, 4).empty());
+    CHECK(graph.managerOf(graph.indexOf(1)) == OrgGraph::npos);
+    CHECK(graph.find(42) == nullptr);
+}
+
+DROGON_TEST(OrgGraphPatchTest)
+{
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1)});
+
+    graph.upsert(makeNode(4, 2));
+    CHECK((reportIds(graph, 2) == std::vector<int32_t>{4}));
+
+    graph.upsert(makeNode(4, 3));
+    CHECK(reportIds(graph, 2).empty());
+    CHECK((reportIds(graph, 3) == std::vector<int32_t>{4}));
+
+    CHECK(graph.erase(2));
+    CHECK_FALSE(graph.erase(2));
+    CHECK((reportIds(graph, 1) == std::vector<int32_t>{3}));
+    CHECK(graph.size() == 3);
+
+    // a report loaded before its manager is linked once the manager shows up
+    graph.upsert(makeNode(6, 5));
+    CHECK(reportIds(graph, 5).empty());
+    graph.upsert(makeNode(5, 1));
+    CHECK((reportIds(graph, 5) == std::vector<int32_t>{6}));
+    CHECK((reportIds(graph, 1) == std::vector<int32_t>{3, 5}));
+}
+
+DROGON_TEST(OrgGraphForEachNodeTest)
+{
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 2)});
+    graph.erase(2);
+
+    // erased slots are skipped
+    std::vector<int32_t> ids;
+    graph.forEachNode([&ids](const OrgGraph::Node &node) { ids.push_back(node.id); });
+    std::sort(ids.begin(), ids.end());
+    CHECK((ids == std::vector<int32_t>{1, 3}));
+}
+
+DROGON_TEST(OrgGraphWalkTest)
+{
+    // 1 -> {2, 3}, 2 -> {4, 5}, 4 -> {6}
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2), makeNode(5, 2), makeNode(6, 4)});
+
+    auto walk = [&graph](int32_t root, std::optional<int32_t> after, uint32_t maxDepth) {
+        std::vector<std::pair<int32_t, uint32_t>> visited;
+        graph.walkSubtree(root, after, maxDepth, [&visited](const OrgGraph::Node &node, uint32_t depth) {
+            visited.emplace_back(node.id, depth);
+            return true;
+        });
+        return visited;
+    };
+
+    using Visits = std::vector<std::pair<int32_t, uint32_t>>;
+    CHECK((walk(1, std::nullopt, 10) == Visits{{2, 1}, {4, 2}, {6, 3}, {5, 2}, {3, 1}}));
+    CHECK((walk(1, std::nullopt, 2) == Visits{{2, 1}, {4, 2}, {5, 2}, {3, 1}}));
+    CHECK((walk(1, 6, 10) == Visits{{5, 2}, {3, 1}}));
+    CHECK((walk(1, 2, 10) == Visits{{4, 2}, {6, 3}, {5, 2}, {3, 1}}));
+    CHECK((walk(2, 4, 10) == Visits{{6, 2}, {5, 1}}));
+
+    // the cursor must sit below the root
+    CHECK_FALSE(graph.walkSubtree(2, 3, 10, [](const OrgGraph::Node &, uint32_t) { return true; }));
+    CHECK_FALSE(graph.walkSubtree(42, std::nullopt, 10, [](const OrgGraph::Node &, uint32_t) { return true; }));
+}
+
+DROGON_TEST(OrgGraphAncestorTest)
+{
+    // 1 -> {2, 3}, 2 -> {4, 5}, 4 -> {6}
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2), makeNode(5, 2), makeNode(6, 4)});
+
+    auto chainIds = [&graph](int32_t id) {
+        std::vector<int32_t> ids;
+        for (const auto *node : graph.chainOf(id)) {
+            ids.push_back(node->id);
+        }
+        return ids;
+    };
+
+    CHECK((chainIds(6) == std::vector<int32_t>{4, 2, 1}));
+    CHECK(chainIds(1).empty());
+    CHECK(graph.depthOf(graph.indexOf(6)) == 3);
+    CHECK(graph.commonManager(6, 5)->id == 2);
+    CHECK(graph.commonManager(6, 3)->id == 1);
+    CHECK(graph.commonManager(4, 6)->id == 4);
+
+    // moving 2 under 3 drags 4, 5 and 6 along
+    graph.upsert(makeNode(2, 3));
+    CHECK((chainIds(6) == std::vector<int32_t>{4, 2, 3, 1}));
+    CHECK(graph.depthOf(graph.indexOf(6)) == 4);
+    CHECK(graph.commonManager(6, 3)->id == 3);
+
+    // a second tree has nothing in common with the first
+    graph.upsert(makeNode(7, 7));
+    graph.upsert(makeNode(8, 7));
+    CHECK(graph.commonManager(8, 6) == nullptr);
+}
+
+DROGON_TEST(OrgGraphRollupTest)
+{
+    // 1 -> {2, 3}, 2 -> {4, 5}, 4 -> {6}; 4, 5 and 6 are in department 2
+    std::vector<OrgGraph::Node> nodes{makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2), makeNode(5, 2), makeNode(6, 4)};
+    for (auto &node : nodes) {
+        node.departmentId = node.id >= 4 ? 2 : 1;
+    }
+    OrgGraph graph(std::move(nodes));
+
+    CHECK(graph.totalCount(graph.indexOf(1)) == 5);
+    CHECK(graph.totalCount(graph.indexOf(2)) == 3);
+    CHECK(graph.directCount(graph.indexOf(2)) == 2);
+    CHECK(graph.departmentStats(1)->headcount == 3);
+    CHECK(graph.departmentStats(1)->managers == 2);
+    CHECK(graph.departmentStats(1)->directReports == 4);
+    CHECK(graph.departmentStats(2)->managers == 1);
+
+    // moving 4 (and 6 with it) under 3
+    auto moved = makeNode(4, 3);
+    moved.departmentId = 2;
+    graph.upsert(moved);
+    CHECK(graph.totalCount(graph.indexOf(1)) == 5);
+    CHECK(graph.totalCount(graph.indexOf(2)) == 1);
+    CHECK(graph.totalCount(graph.indexOf(3)) == 2);
+
+    // 3 changes department and takes its span of control along
+    auto transferred = makeNode(3, 1);
+    transferred.departmentId = 2;
+    graph.upsert(transferred);
+    CHECK(graph.departmentStats(1)->headcount == 2);
+    CHECK(graph.departmentStats(2)->headcount == 4);
+    CHECK(graph.departmentStats(2)->managers == 2);
+    CHECK(graph.departmentStats(2)->directReports == 2);
+
+    graph.erase(6);
+    CHECK(graph.totalCount(graph.indexOf(1)) == 4);
+    CHECK(graph.departmentStats(2)->managers == 1);
+    CHECK(graph.departmentStats(3) == nullptr);
+}
+
+DROGON_TEST(OrgGraphIntervalTest)
+{
+    // 1 -> {2, 3}, 2 -> {4, 5}, 4 -> {6}
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2), makeNode(5, 2), makeNode(6, 4)});
+
+    auto orgIds = [&graph](int32_t id) {
+        std::vector<int32_t> ids;
+        auto range = graph.orgOf(graph.indexOf(id));
+        for (auto it = range.first; it != range.second; ++it) {
+            ids.push_back(graph.node(*it).id);
+        }
+        return ids;
+    };
+
+    CHECK(graph.labelsFresh());
+    CHECK((orgIds(2) == std::vector<int32_t>{4, 6, 5}));
+    CHECK(graph.reportsTo(6, 1));
+    CHECK(graph.reportsTo(6, 2));
+    CHECK_FALSE(graph.reportsTo(6, 3));
+    CHECK_FALSE(graph.reportsTo(2, 2));
+    CHECK_FALSE(graph.reportsTo(1, 6));
+
+    // stale labels still answer correctly through the ancestor index
+    graph.upsert(makeNode(4, 3));
+    CHECK_FALSE(graph.labelsFresh());
+    CHECK(graph.reportsTo(6, 3));
+    CHECK_FALSE(graph.reportsTo(6, 2));
+
+    graph.relabel();
+    CHECK(graph.labelsFresh());
+    CHECK((orgIds(3) == std::vector<int32_t>{4, 6}));
+    CHECK(graph.reportsTo(6, 3));
+}
+
+DROGON_TEST(OrgGraphMoveTest)
+{
+    // 1 -> {2, 3}, 2 -> {4, 5}, 4 -> {6}
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2), makeNode(5, 2), makeNode(6, 4)});
+
+    using Moves = std::vector<OrgGraph::Move>;
+    CHECK(!graph.findCycle(Moves{{2, 3, std::nullopt}, {5, 3, std::nullopt}}));
+    CHECK(graph.findCycle(Moves{{2, 6, std::nullopt}}) == 2);
+    // each move is fine on its own, together they form a loop
+    CHECK(graph.findCycle(Moves{{3, 5, std::nullopt}, {2, 3, std::nullopt}}).has_value());
+    // moving 4 out first makes putting 2 under 6 legal
+    CHECK(!graph.findCycle(Moves{{4, 3, std::nullopt}, {2, 6, std::nullopt}}));
+    // managing oneself moves a person to the top; their old reports may then go under them
+    CHECK(!graph.findCycle(Moves{{4, 4, std::nullopt}}));
+    CHECK(!graph.findCycle(Moves{{4, 4, std::nullopt}, {2, 6, std::nullopt}}));
+
+    graph.applyMoves(Moves{{4, 3, 7}, {2, 6, std::nullopt}});
+    CHECK(graph.find(4)->managerId == 3);
+    CHECK(graph.find(4)->departmentId == 7);
+    CHECK(graph.reportsTo(2, 3));
+    CHECK(graph.totalCount(graph.indexOf(3)) == 4);
+}
+
+DROGON_TEST(OrgGraphLevelTest)
+{
+    //        1
+    //      2   3
+    //     4 5   6
+    //    7
+    OrgGraph graph({makeNode(1, 1), makeNode(2, 1), makeNode(3, 1), makeNode(4, 2),
+                    makeNode(5, 2), makeNode(6, 3), makeNode(7, 4)});
+    auto ids = [](const std::vector<const OrgGraph::Node *> &nodes) {
+        std::vector<int32_t> ids;
+        for (const auto *node : nodes) {
+            ids.push_back(node->id);
+        }
+        return ids;
+    };
+
+    CHECK((ids(graph.reportsAtLevel(1, 2)) == std::vector<int32_t>{4, 5, 6}));
+    CHECK((ids(graph.reportsAtLevel(2, 2)) == std::vector<int32_t>{7}));
+    CHECK(graph.reportsAtLevel(3, 2).empty());
+    CHECK((ids(graph.atDepth(2)) == std::vector<int32_t>{4, 5, 6}));
+
+    // stale labels fall back to a walk and a scan
+    graph.upsert(makeNode(8, 6));
+    CHECK_FALSE(graph.labelsFresh());
+    CHECK((ids(graph.reportsAtLevel(1, 3)) == std::vector<int32_t>{7, 8}));
+    CHECK((ids(graph.atDepth(3)) == std::vector<int32_t>{7, 8}));
+    graph.relabel();
+    CHECK((ids(graph.reportsAtLevel(1, 3)) == std::vector<int32_t>{7, 8}));
+    CHECK((ids(graph.atDepth(3)) == std::vector<int32_t>{7, 8}));
+}
+
+DROGON_TEST(OrgGraphRandomPatchTest)
+{
+    // patches must leave the graph as a rebuild from the same persons would, across
+    // slices that outgrow their room, compaction and persons who arrive before their manager
+    std::mt19937 random(7);
+    auto pick = [&random](int32_t below) { return static_cast<int32_t>(random() % static_cast<uint32_t>(below)); };
+    std::map<int32_t, OrgGraph::Node> persons;
+    OrgGraph graph;
+    auto wouldLoop = [&persons](int32_t id, int32_t managerId) {
+        for (size_t steps = 0; steps <= persons.size(); ++steps) {
+            if (managerId == id) {
+                return true;
+            }
+            auto it = persons.find(managerId);
+            if (it == persons.end() || it->second.managerId == managerId) {
+                return false;
+            }
+            managerId = it->second.managerId;
+        }
+        return true;
+    };
+
+    for (int step = 0; step < 4000; ++step) {
+        auto id = 1 + pick(300);
+        if (persons.count(id) > 0 && pick(4) == 0) {
+            graph.erase(id);
+            persons.erase(id);
+        } else {
+            auto node = makeNode(id, 1 + pick(300));
+            node.departmentId = 1 + pick(3);
+            if (pick(10) == 0 || wouldLoop(id, node.managerId)) {
+                node.managerId = id;
+            }
+            graph.upsert(node);
+            persons[id] = node;
+        }
+        if (step % 97 == 0) {
+            graph.relabel();
+        }
+    }
+    graph.relabel();
+
+    std::vector<OrgGraph::Node> nodes;
+    for (const auto &entry : persons) {
+        nodes.push_back(entry.second);
+    }
+    OrgGraph rebuilt(std::move(nodes));
+    REQUIRE(graph.size() == rebuilt.size());
+    for (const auto &entry : persons) {
+        auto id = entry.first;
+        CHECK(reportIds(graph, id) == reportIds(rebuilt, id));
+        CHECK(graph.totalCount(graph.indexOf(id)) == rebuilt.totalCount(rebuilt.indexOf(id)));
+        CHECK(graph.depthOf(graph.indexOf(id)) == rebuilt.depthOf(rebuilt.indexOf(id)));
+        auto other = 1 + pick(300);
+        CHECK(graph.reportsTo(id, other) == rebuilt.reportsTo(id, other));
+    }
+    for (int32_t department = 1; department <= 3; ++department) {
+        const auto *stats = graph.departmentStats(department);
+        const auto *expected = rebuilt.departmentStats(department);
+        REQUIRE((stats == nullptr) == (expected == nullptr));
+        if (stats != nullptr) {
+            CHECK(stats->headcount == expected->headcount);
+            CHECK(stats->managers == expected->managers);
+            CHECK(stats->directReports == expected->directReports);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#include <drogon/drogon_test.h>
+#include "../plugins/SingleFlight.h"
+
+namespace {
+
+using Flight = SingleFlight<int, std::string>;
+
+struct Pending {
+    std::function<void(const int &)> onResult;
+    std::function<void(const std::string &)> onError;
+};
+
+}  // namespace
+
+DROGON_TEST(SingleFlightCoalesceTest)
+{
+    Flight flight;
+    std::vector<Pending> started;
+    auto start = [&started](auto onResult, auto onError) { started.push_back({onResult, onError}); };
+
+    std::vector<int> results;
+    for (int i = 0; i < 3; ++i) {
+        flight.run("a", [&results](const int &r) { results.push_back(r); }, [](const std::string &) {}, start);
+    }
+    flight.run("b", [&results](const int &r) { results.push_back(r * 10); }, [](const std::string &) {}, start);
+    REQUIRE(started.size() == 2);
+    CHECK(flight.inFlight() == 2);
+    CHECK(flight.coalesced() == 2);
+
+    started[0].onResult(7);
+    CHECK((results == std::vector<int>{7, 7, 7}));
+    CHECK(flight.inFlight() == 1);
+
+    // a finished key starts a new call
+    flight.run("a", [&results](const int &r) { results.push_back(r); }, [](const std::string &) {}, start);
+    CHECK(started.size() == 3);
+
+    std::vector<std::string> errors;
+    flight.run("c", [](const int &) {}, [&errors](const std::string &e) { errors.push_back(e); }, start);
+    flight.run("c", [](const int &) {}, [&errors](const std::string &e) { errors.push_back(e); }, start);
+    started.back().onError("down");
+    CHECK((errors == std::vector<std::string>{"down", "down"}));
+}
+
+DROGON_TEST(SingleFlightForgetTest)
+{
+    Flight flight;
+    std::vector<Pending> started;
+    auto start = [&started](auto onResult, auto onError) { started.push_back({onResult, onError}); };
+
+    std::vector<int> before;
+    std::vector<int> after;
+    flight.run("a", [&before](const int &r) { before.push_back(r); }, [](const std::string &) {}, start);
+    flight.forget();
+    flight.run("a", [&after](const int &r) { after.push_back(r); }, [](const std::string &) {}, start);
+    REQUIRE(started.size() == 2);
+
+    // the detached call must not take the newer call's waiters with it
+    started[0].onResult(1);
+    CHECK((before == std::vector<int>{1}));
+    CHECK(after.empty());
+    CHECK(flight.inFlight() == 1);
+
+    started[1].onResult(2);
+    CHECK((after == std::vector<int>{2}));
+    CHECK(flight.inFlight() == 0);
+}
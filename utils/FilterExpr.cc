@@ -0,0 +1,369 @@
+#include "FilterExpr.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <utility>
+
+namespace {
+
+struct Token {
+    enum class Kind { kWord, kString, kOpen, kClose, kComma, kEnd };
+    Kind kind{Kind::kEnd};
+    std::string text;
+};
+
+auto tokenize(const std::string &text, std::vector<Token> &tokens, std::string &error) -> bool {
+    size_t i = 0;
+    while (i < text.size()) {
+        auto c = static_cast<unsigned char>(text[i]);
+        if (std::isspace(c)) {
+            ++i;
+        } else if (c == '(' || c == ')' || c == ',') {
+            tokens.push_back({c == '(' ? Token::Kind::kOpen : c == ')' ? Token::Kind::kClose : Token::Kind::kComma, std::string(1, text[i])});
+            ++i;
+        } else if (c == '\'') {
+            std::string value;
+            ++i;
+            while (true) {
+                if (i == text.size()) {
+                    error = "unterminated string";
+                    return false;
+                }
+                if (text[i] == '\'') {
+                    if (i + 1 < text.size() && text[i + 1] == '\'') {
+                        value += '\'';
+                        i += 2;
+                        continue;
+                    }
+                    ++i;
+                    break;
+                }
+                value += text[i++];
+            }
+            tokens.push_back({Token::Kind::kString, std::move(value)});
+        } else if (std::isalnum(c) || c == '_' || c == '-') {
+            std::string word;
+            while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_' || text[i] == '-')) {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(text[i++])));
+            }
+            tokens.push_back({Token::Kind::kWord, std::move(word)});
+        } else {
+            error = std::string("unexpected '") + text[i] + "'";
+            return false;
+        }
+    }
+    tokens.push_back({Token::Kind::kEnd, ""});
+    return true;
+}
+
+auto isInteger(const std::string &text) -> bool {
+    auto digits = text.size() > 0 && text[0] == '-' ? text.substr(1) : text;
+    if (digits.empty() || digits.size() > 10 || !std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        return false;
+    }
+    auto value = std::strtoll(text.c_str(), nullptr, 10);
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// YYYY-MM-DD with a real month and day, so Postgres never rejects what got through here
+auto isDate(const std::string &text) -> bool {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') {
+        return false;
+    }
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9}) {
+        if (!std::isdigit(static_cast<unsigned char>(text[i]))) {
+            return false;
+        }
+    }
+    auto year = std::atoi(text.substr(0, 4).c_str());
+    auto month = std::atoi(text.substr(5, 2).c_str());
+    auto day = std::atoi(text.substr(8, 2).c_str());
+    static const int kDays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (year < 1 || month < 1 || month > 12 || day < 1 || day > kDays[month - 1]) {
+        return false;
+    }
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month != 2 || day < 29 || leap;
+}
+
+class Parser {
+ public:
+    Parser(std::vector<Token> tokens, const std::vector<FilterExpr::Column> &columns, std::string &error) :
+      tokens_{std::move(tokens)}, columns_{columns}, error_{error} {}
+
+    auto parse(FilterExpr::Node &root) -> bool {
+        if (!parseOr(root, 0)) {
+            return false;
+        }
+        if (peek().kind != Token::Kind::kEnd) {
+            return fail("unexpected '" + peek().text + "'");
+        }
+        return true;
+    }
+
+ private:
+    auto peek() const -> const Token & { return tokens_[at_]; }
+    auto next() -> const Token & { return tokens_[at_ < tokens_.size() - 1 ? at_++ : at_]; }
+    auto isWord(const char *word) const -> bool { return peek().kind == Token::Kind::kWord && peek().text == word; }
+
+    auto fail(std::string error) -> bool {
+        error_ = std::move(error);
+        return false;
+    }
+
+    // left-deep chains of the same operator are flattened into one node
+    auto parseOr(FilterExpr::Node &node, size_t depth) -> bool {
+        if (!parseAnd(node, depth)) {
+            return false;
+        }
+        while (isWord("or")) {
+            next();
+            FilterExpr::Node right;
+            if (!parseAnd(right, depth)) {
+                return false;
+            }
+            join(node, std::move(right), FilterExpr::Node::Kind::kOr);
+        }
+        return true;
+    }
+
+    auto parseAnd(FilterExpr::Node &node, size_t depth) -> bool {
+        if (!parsePrimary(node, depth)) {
+            return false;
+        }
+        while (isWord("and")) {
+            next();
+            FilterExpr::Node right;
+            if (!parsePrimary(right, depth)) {
+                return false;
+            }
+            join(node, std::move(right), FilterExpr::Node::Kind::kAnd);
+        }
+        return true;
+    }
+
+    static void join(FilterExpr::Node &node, FilterExpr::Node right, FilterExpr::Node::Kind kind) {
+        if (node.kind != kind) {
+            FilterExpr::Node parent;
+            parent.kind = kind;
+            parent.operands.push_back(std::move(node));
+            node = std::move(parent);
+        }
+        if (right.kind == kind) {
+            for (auto &operand : right.operands) {
+                node.operands.push_back(std::move(operand));
+            }
+        } else {
+            node.operands.push_back(std::move(right));
+        }
+    }
+
+    auto parsePrimary(FilterExpr::Node &node, size_t depth) -> bool {
+        if (peek().kind == Token::Kind::kOpen) {
+            if (depth == FilterExpr::kMaxDepth) {
+                return fail("nested more than " + std::to_string(FilterExpr::kMaxDepth) + " levels deep");
+            }
+            next();
+            if (!parseOr(node, depth + 1)) {
+                return false;
+            }
+            if (next().kind != Token::Kind::kClose) {
+                return fail("missing ')'");
+            }
+            return true;
+        }
+        return parseComparison(node);
+    }
+
+    auto parseComparison(FilterExpr::Node &node) -> bool {
+        const auto &name = next();
+        if (name.kind != Token::Kind::kWord) {
+            return fail(name.kind == Token::Kind::kEnd ? "expected a column" : "expected a column, got '" + name.text + "'");
+        }
+        auto column = std::find_if(columns_.begin(), columns_.end(), [&name](const auto &c) { return c.name == name.text; });
+        if (column == columns_.end()) {
+            return fail("unknown column '" + name.text + "'");
+        }
+        if (++comparisons_ > FilterExpr::kMaxComparisons) {
+            return fail("more than " + std::to_string(FilterExpr::kMaxComparisons) + " comparisons");
+        }
+        node.kind = FilterExpr::Node::Kind::kCompare;
+        node.column = &*column;
+
+        static const std::vector<std::pair<std::string, FilterExpr::Op>> kOps{
+            {"eq", FilterExpr::Op::kEq}, {"ne", FilterExpr::Op::kNe}, {"lt", FilterExpr::Op::kLt}, {"le", FilterExpr::Op::kLe},
+            {"gt", FilterExpr::Op::kGt}, {"ge", FilterExpr::Op::kGe}, {"in", FilterExpr::Op::kIn}};
+        const auto &op = next();
+        auto found = std::find_if(kOps.begin(), kOps.end(), [&op](const auto &entry) { return op.kind == Token::Kind::kWord && entry.first == op.text; });
+        if (found == kOps.end()) {
+            return fail("expected eq, ne, lt, le, gt, ge or in after '" + column->name + "'");
+        }
+        node.op = found->second;
+
+        if (node.op != FilterExpr::Op::kIn) {
+            return parseValue(*column, node.values);
+        }
+        if (next().kind != Token::Kind::kOpen) {
+            return fail("expected '(' after in");
+        }
+        while (true) {
+            if (node.values.size() == FilterExpr::kMaxInValues) {
+                return fail("more than " + std::to_string(FilterExpr::kMaxInValues) + " values in a list");
+            }
+            if (!parseValue(*column, node.values)) {
+                return false;
+            }
+            if (peek().kind != Token::Kind::kComma) {
+                break;
+            }
+            next();
+        }
+        if (next().kind != Token::Kind::kClose) {
+            return fail("missing ')' after the values of '" + column->name + "'");
+        }
+        return true;
+    }
+
+    auto parseValue(const FilterExpr::Column &column, std::vector<std::string> &values) -> bool {
+        const auto &value = next();
+        bool valid = false;
+        switch (column.type) {
+        case FilterExpr::Type::kInteger:
+            valid = value.kind == Token::Kind::kWord && isInteger(value.text);
+            break;
+        case FilterExpr::Type::kDate:
+            valid = value.kind == Token::Kind::kWord && isDate(value.text);
+            break;
+        case FilterExpr::Type::kText:
+            valid = value.kind == Token::Kind::kString;
+            break;
+        }
+        if (!valid) {
+            static const char *kExpected[] = {"an integer", "a date (YYYY-MM-DD)", "a quoted string"};
+            return fail("'" + column.name + "' takes " + kExpected[static_cast<int>(column.type)]);
+        }
+        values.push_back(value.text);
+        return true;
+    }
+
+    std::vector<Token> tokens_;
+    const std::vector<FilterExpr::Column> &columns_;
+    std::string &error_;
+    size_t at_{0};
+    size_t comparisons_{0};
+};
+
+auto castOf(FilterExpr::Type type) -> const char * {
+    switch (type) {
+    case FilterExpr::Type::kInteger:
+        return "int";
+    case FilterExpr::Type::kDate:
+        return "date";
+    case FilterExpr::Type::kText:
+        return "text";
+    }
+    return "text";
+}
+
+// {"a","b \"c\""}: every element quoted, so text needs no further care
+auto arrayLiteral(const std::vector<std::string> &values) -> std::string {
+    std::string ret = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        ret += i == 0 ? "\"" : ",\"";
+        for (char c : values[i]) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        ret += '"';
+    }
+    return ret + "}";
+}
+
+// The condition with every placeholder written as "?", which orders operands canonically.
+auto shapeOf(const FilterExpr::Node &node) -> std::string {
+    switch (node.kind) {
+    case FilterExpr::Node::Kind::kCompare:
+        return node.column->name + " " + std::to_string(static_cast<int>(node.op)) + " ?";
+    case FilterExpr::Node::Kind::kAnd:
+    case FilterExpr::Node::Kind::kOr: {
+        std::string ret = node.kind == FilterExpr::Node::Kind::kAnd ? "and(" : "or(";
+        for (const auto &operand : node.operands) {
+            ret += shapeOf(operand) + ",";
+        }
+        return ret + ")";
+    }
+    }
+    return "";
+}
+
+void canonicalize(FilterExpr::Node &node) {
+    if (node.kind == FilterExpr::Node::Kind::kCompare) {
+        return;
+    }
+    for (auto &operand : node.operands) {
+        canonicalize(operand);
+    }
+    // stable, so operands of the same shape keep their order and their values stay paired
+    std::stable_sort(node.operands.begin(), node.operands.end(),
+                     [](const FilterExpr::Node &a, const FilterExpr::Node &b) { return shapeOf(a) < shapeOf(b); });
+}
+
+void renderNode(const FilterExpr::Node &node, const std::string &table, size_t firstParam, FilterExpr::Sql &sql) {
+    if (node.kind != FilterExpr::Node::Kind::kCompare) {
+        sql.condition += "(";
+        for (size_t i = 0; i < node.operands.size(); ++i) {
+            if (i > 0) {
+                sql.condition += node.kind == FilterExpr::Node::Kind::kAnd ? " and " : " or ";
+            }
+            renderNode(node.operands[i], table, firstParam, sql);
+        }
+        sql.condition += ")";
+        return;
+    }
+
+    static const char *kOperators[] = {"=", "<>", "<", "<=", ">", ">="};
+    auto placeholder = "$" + std::to_string(firstParam + sql.params.size());
+    auto column = table + "." + node.column->name;
+    auto cast = castOf(node.column->type);
+    if (node.op == FilterExpr::Op::kIn) {
+        sql.condition += column + " = any(" + placeholder + "::" + cast + "[])";
+        sql.params.push_back(arrayLiteral(node.values));
+    } else {
+        sql.condition += column + " " + kOperators[static_cast<int>(node.op)] + " " + placeholder + "::" + cast;
+        sql.params.push_back(node.values.front());
+    }
+}
+
+}  // namespace
+
+FilterExpr::FilterExpr(Node root) : root_{std::move(root)} {}
+
+auto FilterExpr::parse(const std::string &text, const std::vector<Column> &columns, std::string &error) -> std::optional<FilterExpr> {
+    if (text.size() > kMaxLength) {
+        error = "longer than " + std::to_string(kMaxLength) + " characters";
+        return std::nullopt;
+    }
+    std::vector<Token> tokens;
+    if (!tokenize(text, tokens, error)) {
+        return std::nullopt;
+    }
+    Node root;
+    if (!Parser(std::move(tokens), columns, error).parse(root)) {
+        return std::nullopt;
+    }
+    canonicalize(root);
+    return FilterExpr(std::move(root));
+}
+
+auto FilterExpr::render(const std::string &table, size_t firstParam) const -> Sql {
+    Sql sql;
+    renderNode(root_, table, firstParam, sql);
+    return sql;
+}
+
+auto FilterExpr::root() const -> const Node & {
+    return root_;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Filter expressions for list endpoints, e.g.
+ *
+ *     department_id eq 3 and (hire_date ge 2020-01-01 or manager_id in (1, 2))
+ *
+ * Comparisons are eq, ne, lt, le, gt, ge and in; they combine with and/or
+ * (and binds tighter) and parentheses. Integers and dates are written bare,
+ * text in single quotes with '' for a quote.
+ *
+ * parse() builds a typed AST, checking every column and value against the
+ * columns it is given. render() turns it into a SQL condition with $n
+ * placeholders plus the values to bind, and the text depends only on the
+ * shape of the expression: an in-list is one array parameter however long
+ * it is, nested and/or are flattened and their operands put in a canonical
+ * order, so "a and b" and "b and a" render the same condition. Together
+ * with the caps on size, that keeps the number of distinct statements the
+ * database has to prepare small.
+ */
+class FilterExpr {
+ public:
+    enum class Type { kInteger, kDate, kText };
+
+    struct Column {
+        std::string name;
+        Type type;
+    };
+
+    enum class Op { kEq, kNe, kLt, kLe, kGt, kGe, kIn };
+
+    struct Node {
+        enum class Kind { kAnd, kOr, kCompare };
+        Kind kind{Kind::kCompare};
+        std::vector<Node> operands;  // and/or
+        const Column *column{nullptr};  // compare
+        Op op{Op::kEq};
+        std::vector<std::string> values;
+    };
+
+    struct Sql {
+        std::string condition;
+        std::vector<std::string> params;
+    };
+
+    static constexpr size_t kMaxLength = 2000;
+    static constexpr size_t kMaxComparisons = 16;
+    static constexpr size_t kMaxDepth = 8;
+    static constexpr size_t kMaxInValues = 1000;
+
+    /// Fails with a reason in error. columns must outlive the expression.
+    static auto parse(const std::string &text, const std::vector<Column> &columns, std::string &error) -> std::optional<FilterExpr>;
+
+    /// Columns are qualified with table; placeholders are numbered from firstParam.
+    auto render(const std::string &table, size_t firstParam) const -> Sql;
+    auto root() const -> const Node &;
+
+ private:
+    explicit FilterExpr(Node root);
+
+    Node root_;
+};
@@ -0,0 +1,126 @@
+#include "JsonWriter.h"
+
+namespace {
+
+const char kHex[] = "0123456789abcdef";
+
+void appendEscape(std::string &out, uint32_t unit) {
+    out += "\\u";
+    out += kHex[(unit >> 12) & 0xf];
+    out += kHex[(unit >> 8) & 0xf];
+    out += kHex[(unit >> 4) & 0xf];
+    out += kHex[unit & 0xf];
+}
+
+}  // namespace
+
+void JsonWriter::separate() {
+    if (afterKey_) {
+        afterKey_ = false;
+        return;
+    }
+    if (!filled_.empty()) {
+        if (filled_.back()) {
+            out_ += ',';
+        }
+        filled_.back() = true;
+    }
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    out_ += '{';
+    filled_.push_back(false);
+}
+
+void JsonWriter::endObject() {
+    out_ += '}';
+    filled_.pop_back();
+}
+
+void JsonWriter::beginArray() {
+    separate();
+    out_ += '[';
+    filled_.push_back(false);
+}
+
+void JsonWriter::endArray() {
+    out_ += ']';
+    filled_.pop_back();
+}
+
+void JsonWriter::key(std::string_view name) {
+    separate();
+    quote(name);
+    out_ += ':';
+    afterKey_ = true;
+}
+
+void JsonWriter::value(int64_t number) {
+    separate();
+    out_ += std::to_string(number);
+}
+
+void JsonWriter::value(std::string_view text) {
+    separate();
+    quote(text);
+}
+
+void JsonWriter::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+}
+
+void JsonWriter::null() {
+    separate();
+    out_ += "null";
+}
+
+void JsonWriter::quote(std::string_view text) {
+    out_ += '"';
+    size_t i = 0;
+    while (i < text.size()) {
+        auto c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            // copy the whole run of plain characters at once, UTF-8 bytes included
+            auto start = i;
+            while (i < text.size()) {
+                c = static_cast<unsigned char>(text[i]);
+                if (c < 0x20 || c == '"' || c == '\\') {
+                    break;
+                }
+                ++i;
+            }
+            out_.append(text.data() + start, i - start);
+            continue;
+        }
+        switch (c) {
+        case '"':
+            out_ += "\\\"";
+            break;
+        case '\\':
+            out_ += "\\\\";
+            break;
+        case '\b':
+            out_ += "\\b";
+            break;
+        case '\f':
+            out_ += "\\f";
+            break;
+        case '\n':
+            out_ += "\\n";
+            break;
+        case '\r':
+            out_ += "\\r";
+            break;
+        case '\t':
+            out_ += "\\t";
+            break;
+        default:
+            appendEscape(out_, c);
+            break;
+        }
+        ++i;
+    }
+    out_ += '"';
+}
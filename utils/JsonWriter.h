@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Writes compact JSON straight into a string, for bodies built from query
+ * rows without a Json::Value tree in between. Commas are placed by the
+ * writer; keys are written in the order given, so callers that must match
+ * jsoncpp's output write them sorted. Strings are escaped the way jsoncpp
+ * does with emitUTF8 on, as drogon's newHttpJsonResponse sets it: control
+ * characters become \u escapes and everything else, UTF-8 included, is
+ * copied byte for byte.
+ */
+class JsonWriter {
+ public:
+    explicit JsonWriter(std::string &out) : out_{out} {}
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(std::string_view name);
+    void value(int64_t number);
+    void value(int32_t number) { value(static_cast<int64_t>(number)); }
+    void value(std::string_view text);
+    void value(const char *text) { value(std::string_view(text)); }
+    void value(bool flag);
+    void null();
+
+    /// key then value, for the common case.
+    template <typename Value>
+    void member(std::string_view name, const Value &value) {
+        key(name);
+        this->value(value);
+    }
+
+ private:
+    void separate();
+    void quote(std::string_view text);
+
+    std::string &out_;
+    // per open container, whether something was written into it yet
+    std::vector<bool> filled_;
+    bool afterKey_{false};
+};
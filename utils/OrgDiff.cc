@@ -0,0 +1,69 @@
+#include "OrgDiff.h"
+
+namespace {
+
+Json::Value optionalJson(const std::optional<int32_t> &value) {
+    return value ? Json::Value(*value) : Json::Value();
+}
+
+}  // namespace
+
+void OrgDiff::add(const Entry &entry) {
+    auto key = std::make_pair(entry.entity, entry.entityId);
+    auto it = spans_.find(key);
+    if (it == spans_.end()) {
+        spans_.emplace(std::move(key), Span{entry, entry});
+    } else {
+        it->second.last = entry;
+    }
+}
+
+auto OrgDiff::size() const -> size_t {
+    return spans_.size();
+}
+
+auto OrgDiff::toJson() const -> Json::Value {
+    Json::Value ret{};
+    ret["hires"] = Json::Value(Json::arrayValue);
+    ret["departures"] = Json::Value(Json::arrayValue);
+    ret["moves"] = Json::Value(Json::arrayValue);
+    for (const auto *entity : {"departments", "jobs"}) {
+        ret[entity]["created"] = Json::Value(Json::arrayValue);
+        ret[entity]["updated"] = Json::Value(Json::arrayValue);
+        ret[entity]["deleted"] = Json::Value(Json::arrayValue);
+    }
+
+    for (const auto &[key, span] : spans_) {
+        bool existedBefore = span.first.kind != "create";
+        bool existsAfter = span.last.kind != "delete";
+        if (!existedBefore && !existsAfter) {
+            continue;
+        }
+
+        if (key.first != "person") {
+            auto &bucket = ret[key.first == "department" ? "departments" : "jobs"];
+            auto kind = !existedBefore ? "created" : !existsAfter ? "deleted" : "updated";
+            bucket[kind].append(key.second);
+            continue;
+        }
+
+        Json::Value person{};
+        person["id"] = key.second;
+        if (!existedBefore) {
+            person["manager_id"] = optionalJson(span.last.managerId);
+            person["department_id"] = optionalJson(span.last.departmentId);
+            ret["hires"].append(person);
+        } else if (!existsAfter) {
+            person["manager_id"] = optionalJson(span.first.oldManagerId);
+            person["department_id"] = optionalJson(span.first.oldDepartmentId);
+            ret["departures"].append(person);
+        } else if (span.first.oldManagerId != span.last.managerId || span.first.oldDepartmentId != span.last.departmentId) {
+            person["from_manager_id"] = optionalJson(span.first.oldManagerId);
+            person["to_manager_id"] = optionalJson(span.last.managerId);
+            person["from_department_id"] = optionalJson(span.first.oldDepartmentId);
+            person["to_department_id"] = optionalJson(span.last.departmentId);
+            ret["moves"].append(person);
+        }
+    }
+    return ret;
+}
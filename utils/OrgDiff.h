@@ -0,0 +1,42 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+
+/**
+ * Folds org_journal rows into what changed between two points in time.
+ *
+ * Only the first and the last row of each entity matter: the first says
+ * whether it existed before the window (and, for persons, where it sat),
+ * the last says whether it still exists and where it ended up. A person
+ * hired and let go inside the window does not show up at all.
+ */
+class OrgDiff {
+ public:
+    struct Entry {
+        std::string entity;  // person, department or job
+        int32_t entityId{0};
+        std::string kind;  // create, update or delete
+        std::optional<int32_t> oldManagerId;
+        std::optional<int32_t> managerId;
+        std::optional<int32_t> oldDepartmentId;
+        std::optional<int32_t> departmentId;
+    };
+
+    /// Entries must be added in journal order.
+    void add(const Entry &entry);
+    auto size() const -> size_t;
+    auto toJson() const -> Json::Value;
+
+ private:
+    struct Span {
+        Entry first;
+        Entry last;
+    };
+
+    std::map<std::pair<std::string, int32_t>, Span> spans_;
+};
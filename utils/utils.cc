@@ -1,4 +1,6 @@
 #include "utils.h"
+#include <algorithm>
+#include <cctype>
 
 void badRequest(std::function<void(const drogon::HttpResponsePtr &)> &&callback, std::string err, drogon::HttpStatusCode code)
 {
@@ -14,3 +16,207 @@ Json::Value makeErrResp(std::string err) {
     ret["error"] = err;
     return ret;
 }
+
+
+std::string encodeCursor(const std::string &value) {
+    return drogon::utils::base64Encode(value, true, false);
+}
+
+std::string decodeCursor(const std::string &cursor) {
+    for (auto c : cursor) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+            return {};
+        }
+    }
+    return drogon::utils::base64Decode(cursor);
+}
+
+std::string encodeKeyset(const std::string &sortField, const std::string &sortOrder, const std::string &sortValue, int32_t id) {
+    return encodeCursor(sortField + ' ' + sortOrder + '\x1f' + std::to_string(id) + '\x1f' + sortValue);
+}
+
+bool decodeKeyset(const std::string &cursor, const std::string &sortField, const std::string &sortOrder, std::string &sortValue, int32_t &id) {
+    auto decoded = decodeCursor(cursor);
+    auto first = decoded.find('\x1f');
+    auto second = first == std::string::npos ? std::string::npos : decoded.find('\x1f', first + 1);
+    if (second == std::string::npos || decoded.substr(0, first) != sortField + ' ' + sortOrder) {
+        return false;
+    }
+    try {
+        size_t used = 0;
+        auto idText = decoded.substr(first + 1, second - first - 1);
+        id = std::stoi(idText, &used);
+        if (used != idText.size()) {
+            return false;
+        }
+    } catch (const std::exception &e) {
+        return false;
+    }
+    sortValue = decoded.substr(second + 1);
+    return true;
+}
+
+std::string encodeJournalCursor(const std::string &xid) {
+    return encodeCursor("journal " + xid);
+}
+
+bool decodeJournalCursor(const std::string &cursor, std::string &xid) {
+    static const std::string prefix = "journal ";
+    auto decoded = decodeCursor(cursor);
+    if (decoded.size() <= prefix.size() || decoded.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    xid = decoded.substr(prefix.size());
+    if (!std::all_of(xid.begin(), xid.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        return false;
+    }
+    // Postgres would reject anything past 64 bits
+    try {
+        std::stoull(xid);
+    } catch (const std::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+std::string sortOrderParam(const drogon::HttpRequestPtr &req) {
+    auto order = req->getOptionalParameter<std::string>("sort_order").value_or("asc");
+    std::transform(order.begin(), order.end(), order.begin(), [](unsigned char c) { return std::tolower(c); });
+    return order;
+}
+
+bool parseFields(const std::string &fields, const std::vector<std::string> &names, uint32_t &mask) {
+    mask = 0;
+    size_t start = 0;
+    while (start <= fields.size()) {
+        auto end = std::min(fields.find(',', start), fields.size());
+        auto it = std::find(names.begin(), names.end(), fields.substr(start, end - start));
+        if (it == names.end()) {
+            return false;
+        }
+        mask |= 1u << (it - names.begin());
+        start = end + 1;
+    }
+    return true;
+}
+
+void keepFields(Json::Value &json, const std::vector<std::string> &names, uint32_t mask) {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if ((mask & (1u << i)) == 0) {
+            json.removeMember(names[i]);
+        }
+    }
+}
+
+std::string makeETag(const std::string &seed) {
+    return "\"" + drogon::utils::getMd5(seed) + "\"";
+}
+
+void appendRows(std::string &seed, const drogon::orm::Result &result) {
+    for (const auto &row : result) {
+        for (const auto &field : row) {
+            // unit and record separators keep adjacent values from running together
+            seed += field.isNull() ? "\x1f" : field.c_str();
+            seed += '\x1f';
+        }
+        seed += '\x1e';
+    }
+}
+
+bool matchesETag(const drogon::HttpRequestPtr &req, const std::string &etag) {
+    const auto &header = req->getHeader("if-none-match");
+    if (header.empty()) {
+        return false;
+    }
+    if (header == "*") {
+        return true;
+    }
+    // a comma separated list of tags, each possibly marked weak
+    size_t start = 0;
+    while (start < header.size()) {
+        auto end = header.find(',', start);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        auto tag = header.substr(start, end - start);
+        tag.erase(0, tag.find_first_not_of(' '));
+        tag.erase(tag.find_last_not_of(' ') + 1);
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag.erase(0, 2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+drogon::HttpResponsePtr notModified(const std::string &etag) {
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::k304NotModified);
+    resp->addHeader("ETag", etag);
+    return resp;
+}
+
+std::string serialize(const Json::Value &json) {
+    static const Json::StreamWriterBuilder writer = []() {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        builder["emitUTF8"] = true;
+        return builder;
+    }();
+    return Json::writeString(writer, json);
+}
+
+drogon::HttpResponsePtr jsonBodyResponse(const drogon::HttpRequestPtr &req, const std::string &body) {
+    return jsonBodyResponse(req, body, makeETag(body));
+}
+
+drogon::HttpResponsePtr jsonBodyResponse(const drogon::HttpRequestPtr &req, const std::string &body, const std::string &etag) {
+    if (matchesETag(req, etag)) {
+        return notModified(etag);
+    }
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+    resp->setBody(body);
+    resp->setStatusCode(drogon::k200OK);
+    resp->addHeader("ETag", etag);
+    return resp;
+}
+
+bool parseIds(const std::string &ids, std::vector<int32_t> &out) {
+    out.clear();
+    size_t start = 0;
+    while (start <= ids.size()) {
+        auto end = std::min(ids.find(',', start), ids.size());
+        auto id = ids.substr(start, end - start);
+        if (out.size() == kMaxBatchIds || id.empty() || id.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        try {
+            out.push_back(std::stoi(id));
+        } catch (const std::exception &e) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+std::string idArray(const std::vector<int32_t> &ids) {
+    std::string array = "{";
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i > 0) {
+            array += ',';
+        }
+        array += std::to_string(ids[i]);
+    }
+    return array + "}";
+}
+
+Json::Value notFoundMarker(int32_t id) {
+    auto marker = makeErrResp("resource not found");
+    marker["id"] = id;
+    return marker;
+}
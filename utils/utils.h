@@ -9,3 +9,46 @@ void badRequest (
 );
 
 Json::Value makeErrResp(std::string err);
+
+// Opaque, url-safe pagination cursors. decodeCursor returns an empty string for malformed input.
+std::string encodeCursor(const std::string &value);
+std::string decodeCursor(const std::string &cursor);
+
+// Keyset cursors: the sort field and order and the last row's sort value and id. decodeKeyset
+// fails for malformed cursors and for cursors issued under another sort field or order, which
+// would seek the wrong way.
+std::string encodeKeyset(const std::string &sortField, const std::string &sortOrder, const std::string &sortValue, int32_t id);
+bool decodeKeyset(const std::string &cursor, const std::string &sortField, const std::string &sortOrder, std::string &sortValue, int32_t &id);
+
+// /org/diff cursors: the transaction id the next poll of org_journal starts from, as decimal text.
+std::string encodeJournalCursor(const std::string &xid);
+bool decodeJournalCursor(const std::string &cursor, std::string &xid);
+
+// sort_order= lower-cased, "asc" when absent, so every listing takes ASC as well as asc.
+std::string sortOrderParam(const drogon::HttpRequestPtr &req);
+
+// Sparse fieldsets: fields=a,b sets one bit per requested name, in the order of names,
+// and fails on unknown or empty names. keepFields drops the keys that were not requested.
+bool parseFields(const std::string &fields, const std::vector<std::string> &names, uint32_t &mask);
+void keepFields(Json::Value &json, const std::vector<std::string> &names, uint32_t mask);
+
+// Conditional GET. The tag is derived from whatever the body is built from, so it can be
+// checked before the body is serialized; appendRows adds every column of every row.
+std::string makeETag(const std::string &seed);
+void appendRows(std::string &seed, const drogon::orm::Result &result);
+bool matchesETag(const drogon::HttpRequestPtr &req, const std::string &etag);
+drogon::HttpResponsePtr notModified(const std::string &etag);
+
+// Compact JSON with raw UTF-8, as newHttpJsonResponse writes it, and a 200 carrying an already serialized body (or a 304 if the client has it).
+// Pass the body's tag when it is already known, so it is compared without hashing the body.
+std::string serialize(const Json::Value &json);
+drogon::HttpResponsePtr jsonBodyResponse(const drogon::HttpRequestPtr &req, const std::string &body);
+drogon::HttpResponsePtr jsonBodyResponse(const drogon::HttpRequestPtr &req, const std::string &body, const std::string &etag);
+
+// Batch reads: ids=1,2,3 in request order, repeats kept, at most kMaxBatchIds of them.
+// idArray renders ids as a Postgres array literal for "= any($1::int[])", and ids that
+// matched nothing are answered with notFoundMarker in their place.
+constexpr size_t kMaxBatchIds = 1000;
+bool parseIds(const std::string &ids, std::vector<int32_t> &out);
+std::string idArray(const std::vector<int32_t> &ids);
+Json::Value notFoundMarker(int32_t id);